@@ -0,0 +1,246 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <time.h>
+#include <stdint.h>
+#include "HammingHash.h"
+#include "Connected.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+// Times each stage of the segmentation pipeline over a sweep of
+// image sizes, plane counts, Hamming radii and thread counts, on a
+// synthetic image and on a reference photograph, and prints the
+// distribution of each stage's time as CSV or JSON.
+//
+// Usage: ./benchmark [--json] [--full] [--reps N] [--image path]
+//
+// By default each parameter is swept on its own around a base
+// configuration (640x480, 8 planes, k = 2, all threads); --full sweeps
+// every combination instead.
+
+void colorContours(cv::Mat& base, cv::Mat& codeImg);
+int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes);
+
+static double monotonicSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// The stages timed, in pipeline order.
+enum Stage {
+  STAGE_PROJECT, STAGE_ENCODE, STAGE_MAXIMA, STAGE_MAP,
+  STAGE_COMPONENTS, STAGE_SIMPLIFY, STAGE_CONTOURS, STAGE_TOTAL,
+  NUM_STAGES
+};
+
+static const char* stageNames[NUM_STAGES] = {
+  "projectPixels", "encodeProjections", "hammingMaxima", "mapToMaxima",
+  "findComponents", "simplify", "colorContours", "total"
+};
+
+struct BenchConfig {
+  string image;
+  int width, height;
+  int numPlanes;
+  int hammingK;
+  int numThreads;
+};
+
+// An image of overlapping colored shapes over smooth gradients, with
+// a little noise: flat regions for labeling and simplification to
+// merge, and edges between them. The same for every run.
+static cv::Mat syntheticImage(int width, int height) {
+  cv::Mat img(height, width, CV_8UC3);
+  uint32_t seed = 12345;
+  for(int y = 0; y < height; y++) {
+    uint8_t* row = img.ptr(y);
+    for(int x = 0; x < width; x++) {
+      seed = seed*1664525 + 1013904223;
+      int noise = (seed >> 24) % 7 - 3;
+      int cx = x * 8 / width, cy = y * 6 / height;
+      int shape = (cx + 2*cy) % 5;
+      row[3*x + 0] = (uint8_t)max(0, min(255, 40*shape + x*60/width + noise));
+      row[3*x + 1] = (uint8_t)max(0, min(255, 200 - 30*shape + noise));
+      row[3*x + 2] = (uint8_t)max(0, min(255, y*255/height + noise));
+    }
+  }
+  return img;
+}
+
+// Value at fraction [p] of sorted [samples], by nearest rank.
+static double percentile(const vector<double>& samples, double p) {
+  size_t rank = (size_t)(p * samples.size() + 0.999999);
+  if(rank < 1) rank = 1;
+  if(rank > samples.size()) rank = samples.size();
+  return samples[rank - 1];
+}
+
+static void printResult(const BenchConfig& c, int stage,
+                        vector<double>& samples, bool json, bool first) {
+  sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for(size_t i = 0; i < samples.size(); i++) sum += samples[i];
+  double mean = sum / samples.size();
+  if(json) {
+    printf("%s\n  {\"image\": \"%s\", \"width\": %d, \"height\": %d, "
+           "\"planes\": %d, \"k\": %d, \"threads\": %d, "
+           "\"stage\": \"%s\", \"reps\": %d, \"min_ms\": %.4f, "
+           "\"median_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, "
+           "\"mean_ms\": %.4f}",
+           first ? "" : ",", c.image.c_str(), c.width, c.height,
+           c.numPlanes, c.hammingK, c.numThreads, stageNames[stage],
+           (int)samples.size(), samples[0], percentile(samples, 0.5),
+           percentile(samples, 0.9), percentile(samples, 0.99), mean);
+  }
+  else {
+    printf("%s,%d,%d,%d,%d,%d,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+           c.image.c_str(), c.width, c.height, c.numPlanes, c.hammingK,
+           c.numThreads, stageNames[stage], (int)samples.size(),
+           samples[0], percentile(samples, 0.5), percentile(samples, 0.9),
+           percentile(samples, 0.99), mean);
+  }
+  fflush(stdout);
+}
+
+// Time [reps] runs of the pipeline on [source] (BGR) as configured by
+// [c], after [warmup] untimed runs, and print each stage's timings.
+static void runConfig(const BenchConfig& c, const cv::Mat& source,
+                      int warmup, int reps, bool json, bool& first) {
+#ifdef _OPENMP
+  omp_set_num_threads(c.numThreads);
+#endif
+  cv::Mat imgColor;
+  if(source.cols == c.width && source.rows == c.height) imgColor = source;
+  else cv::resize(source, imgColor, cv::Size(c.width, c.height), 0, 0,
+                  CV_INTER_AREA);
+  cv::Mat imgHSV;
+  cv::cvtColor(imgColor, imgHSV, CV_BGR2HSV);
+
+  // Every run starts from the same planes and makes a single attempt,
+  // so that runs do the same work.
+  RandomGenerator rng(1);
+  vector<float> basePlanes = makeRandomPlanes(c.numPlanes, 3, rng);
+  SegmentationContext ctx;
+  ctx.timeStages = true;
+
+  vector<vector<double> > samples(NUM_STAGES);
+  cv::Mat imgCode, imgDraw;
+  for(int r = 0; r < warmup + reps; r++) {
+    vector<float> planes = basePlanes;
+    imgColor.copyTo(imgDraw);
+    memset(&ctx.stageTimes, 0, sizeof(ctx.stageTimes));
+
+    double start = monotonicSeconds();
+    int numMaxima = hammingHash(ctx, imgHSV, imgCode, planes, c.hammingK, 1);
+    double hashed = monotonicSeconds();
+    int numComponents = numMaxima ? findComponents(imgCode) : 0;
+    double labeled = monotonicSeconds();
+    if(numMaxima) simplify(imgColor, imgCode, numComponents);
+    double simplified = monotonicSeconds();
+    if(numMaxima) colorContours(imgDraw, imgCode);
+    double drawn = monotonicSeconds();
+
+    if(r < warmup) continue;
+    const HashStageTimes& t = ctx.stageTimes;
+    samples[STAGE_PROJECT].push_back(t.project * 1000.0);
+    samples[STAGE_ENCODE].push_back(t.encode * 1000.0);
+    samples[STAGE_MAXIMA].push_back(t.maxima * 1000.0);
+    samples[STAGE_MAP].push_back(t.map * 1000.0);
+    samples[STAGE_COMPONENTS].push_back((labeled - hashed) * 1000.0);
+    samples[STAGE_SIMPLIFY].push_back((simplified - labeled) * 1000.0);
+    samples[STAGE_CONTOURS].push_back((drawn - simplified) * 1000.0);
+    samples[STAGE_TOTAL].push_back((drawn - start) * 1000.0);
+  }
+
+  for(int s = 0; s < NUM_STAGES; s++) {
+    printResult(c, s, samples[s], json, first);
+    first = false;
+  }
+}
+
+int main(int argc, char** argv) {
+  bool json = false, full = false;
+  int reps = 15, warmup = 2;
+  const char* imagePath = "demo/sample/bear-water.jpg";
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--json") == 0) json = true;
+    else if(strcmp(argv[i], "--full") == 0) full = true;
+    else if(strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+      reps = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+      imagePath = argv[++i];
+    else {
+      fprintf(stderr, "Usage: %s [--json] [--full] [--reps N] "
+              "[--image path]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  const int sizes[][2] = { {320, 240}, {640, 480}, {1280, 720}, {1920, 1080} };
+  const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+  const int planeCounts[] = { 6, 8, 12, 16, 24 };
+  const int numPlaneCounts = sizeof(planeCounts) / sizeof(planeCounts[0]);
+  const int radii[] = { 1, 2, 3 };
+  const int numRadii = sizeof(radii) / sizeof(radii[0]);
+  vector<int> threadCounts;
+  for(int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(maxThreads);
+
+  vector<string> imageNames;
+  vector<cv::Mat> images;
+  imageNames.push_back("synthetic");
+  images.push_back(syntheticImage(sizes[numSizes-1][0], sizes[numSizes-1][1]));
+  cv::Mat reference = cv::imread(imagePath);
+  if(reference.empty()) {
+    fprintf(stderr, "Could not read %s; using the synthetic image only\n",
+            imagePath);
+  }
+  else {
+    imageNames.push_back(imagePath);
+    images.push_back(reference);
+  }
+
+  // Base configuration, and how far each parameter is swept from it.
+  const int baseSize = 1, basePlanes = 1, baseRadius = 1;
+  vector<BenchConfig> configs;
+  for(size_t i = 0; i < images.size(); i++) {
+    for(int s = 0; s < numSizes; s++)
+    for(int p = 0; p < numPlaneCounts; p++)
+    for(int k = 0; k < numRadii; k++)
+    for(size_t t = 0; t < threadCounts.size(); t++) {
+      int varied = (s != baseSize) + (p != basePlanes) + (k != baseRadius) +
+                   (t != threadCounts.size() - 1);
+      if(!full && varied > 1) continue;
+      BenchConfig c;
+      c.image = imageNames[i];
+      c.width = sizes[s][0];
+      c.height = sizes[s][1];
+      c.numPlanes = planeCounts[p];
+      c.hammingK = radii[k];
+      c.numThreads = threadCounts[t];
+      configs.push_back(c);
+    }
+  }
+
+  if(json) printf("{\"isa\": %d, \"max_threads\": %d, \"results\": [",
+                  (int)detectProjectionISA(), maxThreads);
+  else printf("image,width,height,planes,k,threads,stage,reps,"
+              "min_ms,median_ms,p90_ms,p99_ms,mean_ms\n");
+  bool first = true;
+  for(size_t c = 0; c < configs.size(); c++) {
+    size_t i = find(imageNames.begin(), imageNames.end(), configs[c].image) -
+               imageNames.begin();
+    runConfig(configs[c], images[i], warmup, reps, json, first);
+  }
+  if(json) printf("\n]}\n");
+  return 0;
+}
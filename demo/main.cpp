@@ -1,5 +1,22 @@
 #include <opencv2/opencv.hpp>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fstream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "HammingHash.h"
+#include "Connected.h"
+#include "PartialSegmentation.h"
+#include "FrameQueue.h"
+#include "DeadlineSegmenter.h"
+#include "EnsembleSegmentation.h"
+#include "TiledSegmentation.h"
+#include "Instrumentation.h"
 using namespace std;
 
 float timeDiff(struct timeval& start, struct timeval& stop) {
@@ -7,12 +24,10 @@ float timeDiff(struct timeval& start, struct timeval& stop) {
          0.000001f * (stop.tv_usec - start.tv_usec);
 }
 
-vector<float> makeRandomPlanes(int numPlanes, int numDimensions);
-int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
-                vector<float>& planes,
-                uint32_t hammingK,
-                int maxRetries = 5);
-int findComponents(cv::Mat& imgIn);
+// Seed for every random plane the demo draws. Set once by main, before
+// any segmentation starts.
+static uint64_t randomSeed = RandomGenerator::DEFAULT_SEED;
+
 void colorContours(cv::Mat& base, cv::Mat& codeImg);
 int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes);
 
@@ -29,8 +44,12 @@ inline void equalizeChannelHistograms(cv::Mat& imgIn) {
 }
 
 void segmentImage(const char* imageFile) {
+  SegmentationContext ctx;
+  ctx.rng.seed(randomSeed);
   // We're using a colorspace with 3 channels, and 8 splitting planes.
-  vector<float> planes = makeRandomPlanes(8,3);
+  vector<float> planes = makeRandomPlanes(8,3,ctx.rng);
+  // Stills may be large; avoid storing a float per pixel per plane.
+  ctx.streamProjections = true;
 
   cv::Mat imgIn = cv::imread(imageFile);
   cv::Mat imgHSV, imgCode;
@@ -38,7 +57,7 @@ void segmentImage(const char* imageFile) {
   gettimeofday(&start, NULL);
   cv::cvtColor(imgIn, imgHSV, CV_BGR2HSV);
   equalizeChannelHistograms(imgHSV);
-  int numMaxima = hammingHash(imgHSV, imgCode, planes, 2, 3);//1);
+  int numMaxima = hammingHash(ctx, imgHSV, imgCode, planes, 2, 3);//1);
   int numComponents = findComponents(imgCode);
   int numSimple = simplify(imgIn, imgCode, numComponents);
   gettimeofday(&stop, NULL);
@@ -48,17 +67,185 @@ void segmentImage(const char* imageFile) {
   printf("Hamming hash took %.1fms\n", timeDiff(start,stop)*1000.0f);
   colorContours(imgIn, imgCode);
   imwrite("coded.png", imgIn);
-  usleep(100000); // Without this, imwrite is sometimes stopped prematurely
 }
 
-void segmentCamera() {
+// As segmentImage, but segmenting the image [numTrials] times at once
+// from different planes and keeping the segmentation that best follows
+// its edges.
+void segmentImageTrials(const char* imageFile, int numTrials) {
   // We're using a colorspace with 3 channels, and 8 splitting planes.
-  vector<float> planes = makeRandomPlanes(8,3);
-  cv::VideoCapture cam = cv::VideoCapture(0);
-  cv::Mat imgIn, imgHSV, imgCode, imgDisplay;
+  EnsembleSegmenter ensemble(numTrials, 8, 2, 3, 3, randomSeed);
+  // Stills may be large; avoid storing a float per pixel per plane.
+  for(int t = 0; t < numTrials; t++)
+    ensemble.trials[t]->ctx.streamProjections = true;
+
+  cv::Mat imgIn = cv::imread(imageFile);
+  cv::Mat imgHSV, imgCode;
+  struct timeval start, stop;
+  gettimeofday(&start, NULL);
+  cv::cvtColor(imgIn, imgHSV, CV_BGR2HSV);
+  equalizeChannelHistograms(imgHSV);
+  int numSimple = ensemble.segment(imgHSV, imgIn, imgCode);
+  gettimeofday(&stop, NULL);
+  for(int t = 0; t < numTrials; t++) {
+    const EnsembleTrial& trial = *ensemble.trials[t];
+    printf("Trial %d: %d Hamming maxima, %d components, %d regions, "
+           "edge precision %.3f, recall %.3f, score %.3f%s\n",
+           t, trial.numMaxima, trial.numComponents, trial.numRegions,
+           trial.precision, trial.recall, trial.score,
+           t == ensemble.bestTrial ? " (best)" : "");
+  }
+  printf("Kept %d regions\n", numSimple);
+  printf("%d trials took %.1fms\n", numTrials,
+         timeDiff(start,stop)*1000.0f);
+  if(numSimple) colorContours(imgIn, imgCode);
+  imwrite("coded.png", imgIn);
+}
+
+// A frame as it moves through the stages of a StreamPipeline.
+struct Frame {
+  // Position of the frame in the stream, counted from 0 as frames are
+  // captured, so that dropped frames show up as gaps.
+  uint64_t seq;
+  cv::Mat imgIn, imgHSV, imgCode;
+  int numLabels;
+  bool keyFrame, fullFrame;
+  int dirtyBlocks;
+  float segmentMs;
+  // The settings chosen for the frame when segmenting to a deadline.
+  DeadlineReport deadline;
+  Frame() : seq(0), numLabels(0), keyFrame(false), fullFrame(true),
+            dirtyBlocks(0), segmentMs(0.0f) {
+    memset(&deadline, 0, sizeof(deadline));
+  }
+};
+
+// Capture, color conversion, segmentation and display each run on a
+// thread of their own (display on the main thread, as HighGUI
+// requires), linked by short queues, so that a frame is converted
+// while the one before it is segmented and the one before that is
+// drawn. The queues hold two frames, which bounds the latency added.
+struct StreamPipeline {
+  cv::VideoCapture source;
+  // Rewind the source when it ends, rather than stopping.
+  bool loop;
+  // Blur frames before converting them (for compressed video).
+  bool blur;
+  // Segment only the parts of each frame that changed (for a fixed
+  // camera).
+  bool partial;
+  // If set, segment each frame within a deadline, trading quality for
+  // time as needed, instead of with the fixed settings above.
+  DeadlineSegmenter* realtime;
+  // What capture does when conversion falls behind: a camera drops
+  // frames, while a video file waits.
+  QueueFullPolicy dropPolicy;
+
+  SegmentationSession session;
+  PartialSegmenter segmenter;
+  FrameQueue<Frame> captured, converted, segmented;
+
+  // Set once the pipeline should shut down.
+  int stop;
+  // Frames the capture stage could not queue.
+  uint64_t dropped;
+
+  StreamPipeline()
+    : loop(false), blur(false), partial(false), realtime(NULL),
+      dropPolicy(QUEUE_BLOCK),
+      // We're using a colorspace with 3 channels, and 8 splitting
+      // planes. Consecutive frames are hashed as a session, which
+      // reuses the maxima of the last key frame while the scene stays
+      // put.
+      session(8, 3, 2, 1, randomSeed), segmenter(session),
+      captured(2), converted(2), segmented(2), stop(0), dropped(0) {
+    // Frames are 8-bit, so table-driven integer projections apply.
+    session.ctx.integerProjections = true;
+  }
+};
+
+static void* captureStage(void* arg) {
+  StreamPipeline& p = *(StreamPipeline*)arg;
+  uint64_t seq = 0;
+  while(!__atomic_load_n(&p.stop, __ATOMIC_RELAXED)) {
+    Frame frame;
+    if(!p.source.read(frame.imgIn)) {
+      if(!p.loop) break;
+      // Loop the video
+      cout << "Looping the video..." << endl;
+      p.source.set(CV_CAP_PROP_POS_FRAMES, 0);
+      continue;
+    }
+    frame.seq = seq++;
+    if(!p.captured.push(frame, p.dropPolicy, &p.stop))
+      __atomic_fetch_add(&p.dropped, 1, __ATOMIC_RELAXED);
+  }
+  // An empty frame tells the later stages that the stream has ended.
+  p.captured.push(Frame(), QUEUE_BLOCK, &p.stop);
+  return NULL;
+}
+
+static void* convertStage(void* arg) {
+  StreamPipeline& p = *(StreamPipeline*)arg;
+  Frame frame;
+  while(p.captured.pop(frame, true, &p.stop)) {
+    if(!frame.imgIn.empty()) {
+      if(p.blur) cv::GaussianBlur(frame.imgIn, frame.imgIn, cv::Size(3,3), 0);
+      cv::cvtColor(frame.imgIn, frame.imgHSV, CV_BGR2HSV);
+      equalizeChannelHistograms(frame.imgHSV);
+    }
+    p.converted.push(frame, QUEUE_BLOCK, &p.stop);
+    if(frame.imgIn.empty()) break;
+  }
+  return NULL;
+}
+
+static void* segmentStage(void* arg) {
+  StreamPipeline& p = *(StreamPipeline*)arg;
+  Frame frame;
   struct timeval start, stop;
+  while(p.converted.pop(frame, true, &p.stop)) {
+    if(!frame.imgIn.empty()) {
+      gettimeofday(&start, NULL);
+      if(p.realtime) {
+        frame.numLabels = p.realtime->segment(frame.imgHSV, frame.imgIn,
+                                              frame.imgCode);
+        frame.deadline = p.realtime->lastFrame;
+      }
+      else if(p.partial) {
+        frame.numLabels = p.segmenter.segment(frame.imgHSV, frame.imgIn,
+                                              frame.imgCode);
+        frame.fullFrame = p.segmenter.lastFrameFull;
+        frame.dirtyBlocks = p.segmenter.lastDirtyBlocks;
+      }
+      else if(p.session.hash(frame.imgHSV, frame.imgCode)) {
+        int numComponents = findComponents(frame.imgCode);
+        simplify(frame.imgHSV, frame.imgCode, numComponents);
+        frame.numLabels = numComponents;
+      }
+      gettimeofday(&stop, NULL);
+      frame.segmentMs = timeDiff(start,stop)*1000.0f;
+      frame.keyFrame = p.realtime ? frame.deadline.keyFrame
+                                  : !p.session.lastFrameWarm;
+    }
+    p.segmented.push(frame, QUEUE_BLOCK, &p.stop);
+    if(frame.imgIn.empty()) break;
+  }
+  return NULL;
+}
+
+// Run [p] until its source ends or Esc is pressed, drawing each
+// segmented frame as it arrives.
+void runPipeline(StreamPipeline& p) {
   const char* title = "Hamming Hasher: Esc=Exit, Space=Pause/Resume";
   cv::namedWindow(title, CV_WINDOW_AUTOSIZE);
+  pthread_t threads[3];
+  pthread_create(&threads[0], NULL, captureStage, &p);
+  pthread_create(&threads[1], NULL, convertStage, &p);
+  pthread_create(&threads[2], NULL, segmentStage, &p);
+
+  struct timeval last, now;
+  gettimeofday(&last, NULL);
   while(1) {
     int key = cv::waitKey(1);
     // esc to exit, space to pause/unpause
@@ -66,61 +253,373 @@ void segmentCamera() {
     else if(key == 32)
       while(cv::waitKey(100) != 32);
 
-    cam >> imgIn;
+    Frame frame;
+    if(!p.segmented.pop(frame, false, &p.stop)) continue;
+    if(frame.imgIn.empty()) break;
+    if(frame.numLabels) {
+      gettimeofday(&now, NULL);
+      float frameMs = timeDiff(last,now)*1000.0f;
+      last = now;
+      if(p.realtime) {
+        const QualityLevel& q = frame.deadline.settings;
+        printf("Frame %llu: level %d (scale %.2f, %d planes, k=%d, "
+               "%d tries%s), predicted %.1fms;",
+               (unsigned long long)frame.seq, frame.deadline.level,
+               q.scale, q.numPlanes, q.hammingK, q.maxRetries,
+               q.simplify ? "" : ", no simplify",
+               frame.deadline.predictedMs);
+        printf(" hash %.1fms, label %.1fms, simplify %.1fms, resize %.1fms\n",
+               frame.deadline.timings.hashMs, frame.deadline.timings.labelMs,
+               frame.deadline.timings.simplifyMs,
+               frame.deadline.timings.resizeMs);
+      }
+      if(frame.fullFrame)
+        printf("Frame %llu: segmented the whole frame",
+               (unsigned long long)frame.seq);
+      else
+        printf("Frame %llu: segmented %d changed blocks",
+               (unsigned long long)frame.seq, frame.dirtyBlocks);
+      printf(" in %.1fms%s; %.1f fps, %llu dropped\n", frame.segmentMs,
+             frame.keyFrame ? " (key frame)" : "", 1000.0f / frameMs,
+             (unsigned long long)__atomic_load_n(&p.dropped,
+                                                 __ATOMIC_RELAXED));
+      colorContours(frame.imgIn, frame.imgCode);
+    }
+    cv::imshow(title, frame.imgIn);
+  }
+
+  __atomic_store_n(&p.stop, 1, __ATOMIC_RELAXED);
+  // Stages asleep on a queue only notice [stop] once woken.
+  p.captured.wake();
+  p.converted.wake();
+  p.segmented.wake();
+  for(int t = 0; t < 3; t++) pthread_join(threads[t], NULL);
+}
+
+// Segment the camera's frames. With a positive [deadlineMs], each
+// frame is segmented within that many milliseconds, at whatever
+// quality fits. Otherwise, if [staticCamera] is set, the camera is
+// assumed not to move, and only the parts of each frame that changed
+// are segmented again.
+void segmentCamera(float deadlineMs, bool staticCamera) {
+  StreamPipeline p;
+  p.source.open(0);
+  // A live camera must not fall behind: frames that arrive while
+  // conversion is busy are dropped.
+  p.dropPolicy = QUEUE_DROP;
+  p.partial = staticCamera;
+
+  QualityLevel best = { 1.0f, 8, 2, 1, true };
+  DeadlineSegmenter realtime(deadlineMs, best, 3, randomSeed);
+  realtime.session.ctx.integerProjections = true;
+  if(deadlineMs > 0.0f) p.realtime = &realtime;
+  runPipeline(p);
+}
+
+void segmentVideo(const char* videoFile) {
+  StreamPipeline p;
+  p.source.open(videoFile);
+  p.loop = true;
+  p.blur = true;
+  runPipeline(p);
+}
+
+// Time spent on each stage of batch segmentation, in seconds.
+struct BatchTimings {
+  double read, decode, convert, hash, label, simplify, draw, encode, write;
+  BatchTimings() : read(0), decode(0), convert(0), hash(0), label(0),
+                   simplify(0), draw(0), encode(0), write(0) {}
+};
+
+// A still on its way through a batch: the bytes of its file on the
+// way to a worker, and those of its encoded result on the way back.
+struct BatchItem {
+  // An empty path tells a worker to stop.
+  string path;
+  // Position of the still in the batch, which selects the stream of
+  // random numbers its retries draw from.
+  size_t index;
+  cv::Mat bytes;
+  bool ok;
+  BatchItem() : index(0), ok(false) {}
+};
+
+// A batch worker decodes, segments and encodes stills with buffers of
+// its own, fed by the I/O thread through queues of its own.
+struct BatchWorker {
+  pthread_t thread;
+  FrameQueue<BatchItem> in, out;
+  SegmentationContext ctx;
+  // The planes every still starts from.
+  const vector<float>* planes;
+  BatchTimings timings;
+  int stop;
+  // The I/O thread waits on [signal] for any worker's queues to move.
+  explicit BatchWorker(QueueSignal* signal)
+    : in(2, signal), out(2, signal), planes(NULL), stop(0) {
+    // Stills may be large; avoid storing a float per pixel per plane.
+    ctx.streamProjections = true;
+  }
+};
+
+static void* batchWorker(void* arg) {
+  BatchWorker& w = *(BatchWorker*)arg;
+#ifdef _OPENMP
+  // Workers already keep every core busy.
+  omp_set_num_threads(1);
+#endif
+  cv::Mat imgHSV, imgCode;
+  vector<uchar> encoded;
+  struct timeval start, stop;
+  BatchItem item;
+  while(w.in.pop(item, true, &w.stop) && !item.path.empty()) {
     gettimeofday(&start, NULL);
-    cv::cvtColor(imgIn, imgHSV, CV_BGR2HSV);
-    equalizeChannelHistograms(imgHSV);
-    int numMaxima = hammingHash(imgHSV, imgCode, planes, 2, 1);
-    if(numMaxima) {
+    cv::Mat imgIn = cv::imdecode(item.bytes, CV_LOAD_IMAGE_COLOR);
+    gettimeofday(&stop, NULL);
+    w.timings.decode += timeDiff(start, stop);
+    item.ok = !imgIn.empty();
+    if(item.ok) {
+      start = stop;
+      cv::cvtColor(imgIn, imgHSV, CV_BGR2HSV);
+      equalizeChannelHistograms(imgHSV);
+      gettimeofday(&stop, NULL);
+      w.timings.convert += timeDiff(start, stop);
+      start = stop;
+      // Each still draws from a stream of its own, so its segmentation
+      // does not depend on which worker gets it.
+      w.ctx.rng.seed(randomSeed, item.index + 1);
+      vector<float> planes = *w.planes;
+      item.ok = hammingHash(w.ctx, imgHSV, imgCode, planes, 2, 3) > 0;
+      gettimeofday(&stop, NULL);
+      w.timings.hash += timeDiff(start, stop);
+    }
+    if(item.ok) {
+      start = stop;
       int numComponents = findComponents(imgCode);
-      int numSimple = simplify(imgIn, imgCode, numComponents);
       gettimeofday(&stop, NULL);
-      printf("%d Hamming maxima; %d components; ", numMaxima, numComponents);
-      printf(" %d regions after simplification\n", numSimple);
-      printf("Hamming hash took %.1fms\n", timeDiff(start,stop)*1000.0f);
+      w.timings.label += timeDiff(start, stop);
+      start = stop;
+      simplify(imgIn, imgCode, numComponents);
+      gettimeofday(&stop, NULL);
+      w.timings.simplify += timeDiff(start, stop);
+      start = stop;
       colorContours(imgIn, imgCode);
+      gettimeofday(&stop, NULL);
+      w.timings.draw += timeDiff(start, stop);
+      start = stop;
+      cv::imencode(".png", imgIn, encoded);
+      item.bytes = cv::Mat(encoded, true);
+      gettimeofday(&stop, NULL);
+      w.timings.encode += timeDiff(start, stop);
     }
-    cv::imshow(title, imgIn);
+    w.out.push(item, QUEUE_BLOCK, &w.stop);
   }
+  return NULL;
 }
 
-void segmentVideo(const char* videoFile) {
+static bool hasImageExtension(const string& name) {
+  static const char* extensions[] = {
+    ".jpg", ".jpeg", ".png", ".bmp", ".ppm", ".pgm", ".tif", ".tiff"
+  };
+  size_t dot = name.rfind('.');
+  if(dot == string::npos) return false;
+  string ext = name.substr(dot);
+  for(size_t i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+  for(size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+    if(ext == extensions[i]) return true;
+  return false;
+}
+
+// The stills named by [input]: the images in it if it is a directory,
+// and otherwise the paths listed in it, one per line.
+static vector<string> listStills(const char* input) {
+  vector<string> paths;
+  struct stat st;
+  if(stat(input, &st) == 0 && S_ISDIR(st.st_mode)) {
+    DIR* dir = opendir(input);
+    struct dirent* entry;
+    while(dir && (entry = readdir(dir))) {
+      if(hasImageExtension(entry->d_name))
+        paths.push_back(string(input) + "/" + entry->d_name);
+    }
+    if(dir) closedir(dir);
+    sort(paths.begin(), paths.end());
+  }
+  else {
+    ifstream manifest(input);
+    string line;
+    while(getline(manifest, line))
+      if(!line.empty()) paths.push_back(line);
+  }
+  return paths;
+}
+
+static bool readFile(const string& path, cv::Mat& bytes) {
+  ifstream file(path.c_str(), ios::binary | ios::ate);
+  if(!file) return false;
+  streamsize size = file.tellg();
+  if(size <= 0) return false;
+  file.seekg(0);
+  bytes.create(1, size, CV_8U);
+  return (bool)file.read((char*)bytes.data, size);
+}
+
+static bool writeFile(const string& path, const cv::Mat& bytes) {
+  ofstream file(path.c_str(), ios::binary);
+  file.write((const char*)bytes.data, bytes.total()*bytes.elemSize());
+  return (bool)file;
+}
+
+// Where the result for [path] is written in [outDir].
+static string resultPath(const string& path, const char* outDir) {
+  size_t slash = path.rfind('/');
+  string name = slash == string::npos ? path : path.substr(slash + 1);
+  size_t dot = name.rfind('.');
+  if(dot != string::npos) name = name.substr(0, dot);
+  return string(outDir) + "/" + name + ".png";
+}
+
+// Segment every still named by [input] (see listStills), writing each
+// with its contours drawn to [outDir]. Files are read and written by
+// this thread alone, while [numWorkers] workers decode, segment and
+// encode.
+void segmentBatch(const char* input, const char* outDir, int numWorkers) {
+  vector<string> paths = listStills(input);
+  if(numWorkers < 1) numWorkers = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
   // We're using a colorspace with 3 channels, and 8 splitting planes.
-  vector<float> planes = makeRandomPlanes(8,3);
-  cv::VideoCapture vid = cv::VideoCapture(videoFile);
-  cv::Mat imgIn, imgHSV, imgCode;
-  struct timeval start, stop;
-  const char* title = "Hamming Hasher: Esc=Exit, Space=Pause/Resume";
-  cv::namedWindow(title, CV_WINDOW_AUTOSIZE);
-  while(1) {
-    int key = cv::waitKey(1);
-    // esc to exit, space to pause/unpause
-    if(key == 27) break;
-    else if(key == 32)
-      while(cv::waitKey(100) != 32);
+  RandomGenerator rng(randomSeed);
+  vector<float> planes = makeRandomPlanes(8,3,rng);
+  // Advanced whenever a worker takes a still or returns a result.
+  QueueSignal workersMoved;
+  vector<BatchWorker*> workers(numWorkers);
+  for(int w = 0; w < numWorkers; w++) {
+    workers[w] = new BatchWorker(&workersMoved);
+    workers[w]->planes = &planes;
+    pthread_create(&workers[w]->thread, NULL, batchWorker, workers[w]);
+  }
 
-    if(!vid.read(imgIn)) {
-      // Loop the video
-      cout << "Looping the video..." << endl;
-      vid.set(CV_CAP_PROP_POS_FRAMES, 0);
-      continue;
+  struct timeval begin, start, stop;
+  gettimeofday(&begin, NULL);
+  BatchTimings io;
+  size_t next = 0, done = 0, failed = 0;
+  int nextWorker = 0;
+  BatchItem pending;
+  while(done < paths.size()) {
+    unsigned int seen = workersMoved.current();
+    bool busy = false;
+
+    // Write out whatever the workers have finished.
+    for(int w = 0; w < numWorkers; w++) {
+      BatchItem result;
+      while(workers[w]->out.pop(result, false, &workers[w]->stop)) {
+        busy = true;
+        done++;
+        gettimeofday(&start, NULL);
+        if(!result.ok || !writeFile(resultPath(result.path, outDir),
+                                    result.bytes)) {
+          fprintf(stderr, "Could not segment %s\n", result.path.c_str());
+          failed++;
+        }
+        gettimeofday(&stop, NULL);
+        io.write += timeDiff(start, stop);
+      }
     }
-    gettimeofday(&start, NULL);
-    cv::GaussianBlur(imgIn, imgIn, cv::Size(3,3), 0);
-    cv::cvtColor(imgIn, imgHSV, CV_BGR2HSV);
-    equalizeChannelHistograms(imgHSV);
-    int numMaxima = hammingHash(imgHSV, imgCode, planes, 2, 1);
-    if(numMaxima) {
-      int numComponents = findComponents(imgCode);
-      int numSimple = simplify(imgHSV, imgCode, numComponents);
+
+    // Read the next still, and hand it to the first worker with room.
+    if(pending.path.empty() && next < paths.size()) {
+      pending.index = next;
+      pending.path = paths[next++];
+      gettimeofday(&start, NULL);
+      bool read = readFile(pending.path, pending.bytes);
       gettimeofday(&stop, NULL);
-      printf("%d Hamming maxima; %d components; ", numMaxima, numComponents);
-      printf(" %d regions after simplification\n", numSimple);
-      printf("Hamming hash took %.1fms\n", timeDiff(start,stop)*1000.0f);
-      colorContours(imgIn, imgCode);
+      io.read += timeDiff(start, stop);
+      if(!read) {
+        fprintf(stderr, "Could not read %s\n", pending.path.c_str());
+        pending = BatchItem();
+        done++;
+        failed++;
+        busy = true;
+      }
     }
-    cv::imshow(title, imgIn);
+    if(!pending.path.empty()) {
+      for(int i = 0; i < numWorkers; i++) {
+        int w = (nextWorker + i) % numWorkers;
+        if(workers[w]->in.push(pending, QUEUE_DROP, &workers[w]->stop)) {
+          pending = BatchItem();
+          nextWorker = (w + 1) % numWorkers;
+          busy = true;
+          break;
+        }
+      }
+    }
+
+    // Every worker's queue is full or empty: sleep until one moves.
+    if(!busy) workersMoved.wait(seen, NULL);
   }
+  gettimeofday(&stop, NULL);
+  double elapsed = timeDiff(begin, stop);
+
+  BatchTimings total = io;
+  for(int w = 0; w < numWorkers; w++) {
+    workers[w]->in.push(BatchItem(), QUEUE_BLOCK, &workers[w]->stop);
+    pthread_join(workers[w]->thread, NULL);
+    const BatchTimings& t = workers[w]->timings;
+    total.decode += t.decode;
+    total.convert += t.convert;
+    total.hash += t.hash;
+    total.label += t.label;
+    total.simplify += t.simplify;
+    total.draw += t.draw;
+    total.encode += t.encode;
+    delete workers[w];
+  }
+
+  size_t n = paths.size();
+  printf("Segmented %lu of %lu images in %.2fs with %d workers: "
+         "%.1f images/s\n", (unsigned long)(n - failed), (unsigned long)n,
+         elapsed, numWorkers, n / elapsed);
+  if(n == 0) return;
+  // Per-image means; worker stages overlap each other and I/O.
+  printf("Per image: read %.1fms, decode %.1fms, convert %.1fms, "
+         "hash %.1fms, label %.1fms, simplify %.1fms, draw %.1fms, "
+         "encode %.1fms, write %.1fms\n",
+         total.read * 1000.0 / n, total.decode * 1000.0 / n,
+         total.convert * 1000.0 / n, total.hash * 1000.0 / n, total.label * 1000.0 / n,
+         total.simplify * 1000.0 / n, total.draw * 1000.0 / n,
+         total.encode * 1000.0 / n, total.write * 1000.0 / n);
+}
+
+static void rgbToHSV(const cv::Mat& tileIn, cv::Mat& tileOut) {
+  cv::cvtColor(tileIn, tileOut, CV_RGB2HSV);
+}
+
+// Segment a binary PPM image too large for memory, [tileSize] pixels
+// square at a time, writing a 32-bit label per pixel to [labelsFile].
+// Histograms are not equalized, as that would need the whole image.
+void segmentTiled(const char* imageFile, const char* labelsFile,
+                  int tileSize) {
+  RandomGenerator rng(randomSeed);
+  // We're using a colorspace with 3 channels, and 8 splitting planes.
+  TiledSegmenter tiled(makeRandomPlanes(8,3,rng), 2, 3);
+  tiled.ctx.rng.seed(randomSeed, 1);
+  if(tileSize > 0) tiled.tileSize = tileSize;
+  tiled.convert = rgbToHSV;
+
+  struct timeval start, stop;
+  gettimeofday(&start, NULL);
+  int numRegions = tiled.segment(imageFile, labelsFile);
+  gettimeofday(&stop, NULL);
+  if(numRegions < 0) {
+    fprintf(stderr, "Could not segment %s into %s\n", imageFile, labelsFile);
+    return;
+  }
+  printf("Found %d Hamming maxima in %d attempts; %lu components within "
+         "tiles joined into %d regions\n", tiled.lastMaxima,
+         tiled.lastAttempts, (unsigned long)tiled.lastTileComponents,
+         numRegions);
+  printf("Segmenting %dx%d pixels in %d pixel tiles took %.1fs\n",
+         tiled.lastWidth, tiled.lastHeight, tiled.tileSize,
+         timeDiff(start, stop));
 }
 
 bool isVideoFile(const char* fileName) {
@@ -134,22 +633,77 @@ bool isVideoFile(const char* fileName) {
   return false;
 }
 
+// Write the calls recorded since instrumentation was enabled to
+// [path], as CSV if its name ends in .csv and as JSON otherwise.
+void writeTrace(const char* path) {
+  vector<CallRecord> records;
+  drainInstrumentation(records);
+  FILE* out = fopen(path, "w");
+  if(!out) {
+    fprintf(stderr, "Could not write %s\n", path);
+    return;
+  }
+  size_t len = strlen(path);
+  if(len > 4 && strcmp(path + len - 4, ".csv") == 0)
+    writeRecordsCSV(out, records);
+  else
+    writeRecordsJSON(out, records);
+  fclose(out);
+  printf("Wrote %lu calls to %s", (unsigned long)records.size(), path);
+  uint64_t dropped = instrumentationDropped();
+  if(dropped) printf(" (%llu earlier calls dropped)", (unsigned long long)dropped);
+  printf("\n");
+}
+
 int main(int argc, char** argv) {
-  // Seed the PRNG with current milliseconds.
-  // Comment out the srand to make results repeatable.
-  struct timeval t;
-  gettimeofday(&t, NULL);
-  srand((t.tv_sec*1000) + (t.tv_usec / 1000));
+  // Seed the PRNG with current milliseconds, unless a seed is given
+  // to repeat an earlier run.
+  if(argc >= 3 && strcmp(argv[1], "--seed") == 0) {
+    randomSeed = strtoull(argv[2], NULL, 0);
+    // Parse the remaining arguments as if there were no seed.
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
+  else {
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    randomSeed = (uint64_t)t.tv_sec*1000 + t.tv_usec / 1000;
+  }
+  printf("Seed: %llu\n", (unsigned long long)randomSeed);
+
+  // Set SEGMENT_TRACE to a file name to record every call to
+  // hammingHash, findComponents and simplify there.
+  const char* tracePath = getenv("SEGMENT_TRACE");
+  if(tracePath) enableInstrumentation(1 << 16, true);
   
   if(argc == 1) 
-    segmentCamera();
+    segmentCamera(0.0f, false);
+  else if(argc == 2 && strcmp(argv[1], "--static-camera") == 0)
+    segmentCamera(0.0f, true);
+  else if((argc == 4 || argc == 5) && strcmp(argv[1], "--tiled") == 0)
+    segmentTiled(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : 0);
+  else if(argc == 4 && strcmp(argv[1], "--trials") == 0)
+    segmentImageTrials(argv[3], max(1, atoi(argv[2])));
+  else if(argc == 3 && strcmp(argv[1], "--deadline") == 0)
+    segmentCamera(atof(argv[2]), false);
+  else if((argc == 4 || argc == 5) && strcmp(argv[1], "--batch") == 0)
+    segmentBatch(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : 0);
   else if(argc == 2) {
     if(isVideoFile(argv[1])) segmentVideo(argv[1]); 
     else segmentImage(argv[1]);
   }
   else {
-    cout << "Usage: ./segment imgFile" << endl;
+    cout << "Usage: ./segment [--seed n] [imgFile | videoFile |" << endl;
+    cout << "                  --static-camera | --trials n imgFile |"
+         << endl;
+    cout << "                  --deadline ms |" << endl;
+    cout << "                  --batch dirOrManifest outDir [numWorkers] |"
+         << endl;
+    cout << "                  --tiled image.ppm labelsFile [tileSize]]"
+         << endl;
     return 1;
   }
+  if(tracePath) writeTrace(tracePath);
   return 0;
 }
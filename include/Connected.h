@@ -0,0 +1,24 @@
+#ifndef CONNECTED_H_8FJ2WQ5T
+#define CONNECTED_H_8FJ2WQ5T
+#include <opencv2/opencv.hpp>
+
+// How findComponents scans each row of an image.
+enum LabelingMode {
+  // Decide each pixel's component from its left and upper neighbors.
+  LABEL_PIXELS = 0,
+
+  // Split each row into runs of equal code, join runs that overlap
+  // runs of the same code in the row above, and fill each run with
+  // its label. Much less work on the large flat regions hashing
+  // produces.
+  LABEL_RUNS = 1
+};
+
+// Distinguish connected components from other regions with the same
+// code. Each component of the coded image [imgIn] (CV_32S) is given
+// an identifier, starting from 2 in the order in which components
+// first appear in raster order, and the returned value is one more
+// than the largest identifier. Both modes produce the same labels.
+int findComponents(cv::Mat& imgIn, LabelingMode mode = LABEL_RUNS);
+
+#endif /* end of include guard: CONNECTED_H_8FJ2WQ5T */
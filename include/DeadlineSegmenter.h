@@ -0,0 +1,114 @@
+#ifndef DEADLINESEGMENTER_H_M8WQ4L2V
+#define DEADLINESEGMENTER_H_M8WQ4L2V
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "HammingHash.h"
+
+// The settings a frame is segmented with.
+struct QualityLevel {
+  // Fraction of the frame's width and height that is segmented; the
+  // labels are scaled back up to the full frame.
+  float scale;
+  int numPlanes;
+  int hammingK;
+  // Attempts hammingHash may make on a key frame (its maxRetries).
+  int maxRetries;
+  // Whether components are merged by simplify.
+  bool simplify;
+};
+
+// Time spent on each stage of a frame, in milliseconds.
+struct StageTimings {
+  float resizeMs, hashMs, labelMs, simplifyMs;
+  float totalMs() const { return resizeMs + hashMs + labelMs + simplifyMs; }
+};
+
+// What the last frame was segmented with, and what it cost.
+struct DeadlineReport {
+  // Index of the level used in DeadlineSegmenter::levels.
+  int level;
+  QualityLevel settings;
+  // The cost the controller expected of the level, and what it took.
+  float predictedMs;
+  StageTimings timings;
+  bool keyFrame;
+};
+
+/*
+ * A DeadlineSegmenter segments a stream of frames (hash, label and
+ * simplify), each within a deadline. It keeps a model of what every
+ * stage costs per pixel (and, for hashing, per plane and attempt),
+ * fitted to the timings of the frames it has segmented, and uses it to
+ * pick the best of its quality [levels] that is predicted to fit the
+ * deadline. Hashing is always costed as a key frame, which may come at
+ * any time. Quality drops as soon as a frame is predicted to miss, and
+ * only rises once the better level has been predicted to fit for
+ * [upgradeFrames] frames in a row, so that the level does not
+ * oscillate.
+ */
+class DeadlineSegmenter {
+public:
+  // Levels are derived from [best]: fewer attempts, then lower
+  // resolution, a smaller Hamming radius, fewer planes and no
+  // simplification, and finally a quarter of the resolution. Frames
+  // are expected to have [numChannels] channels. Planes are drawn from
+  // the session's generator, seeded with [seed].
+  DeadlineSegmenter(float deadlineMs, const QualityLevel& best,
+                    int numChannels = 3,
+                    uint64_t seed = RandomGenerator::DEFAULT_SEED);
+
+  // Segment [imgIn], the image that is hashed (e.g. HSV), into region
+  // labels in [labels] (CV_32S), with edge support taken from
+  // [imgColor]. Returns one more than the largest label, or 0 if no
+  // Hamming maxima were found.
+  int segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+              cv::Mat& labels);
+
+  // Frames should take no longer than this.
+  float deadlineMs;
+
+  // Plan for this fraction of the deadline, leaving the rest for
+  // timing noise. Defaults to 0.85.
+  float headroom;
+
+  // Frames a better level must be predicted to fit before it is used.
+  // Defaults to 15.
+  int upgradeFrames;
+
+  // Quality levels from best to cheapest.
+  std::vector<QualityLevel> levels;
+
+  // The session frames are hashed with; its planes, hammingK and
+  // maxRetries are set from the level in use.
+  SegmentationSession session;
+
+  DeadlineReport lastFrame;
+
+private:
+  int level;
+  int framesFitting;
+
+  // Fitted cost of each stage, in milliseconds per pixel segmented
+  // (per full-size pixel for resizing, and per pixel, plane and attempt
+  // for hashing a key frame). Negative until first measured.
+  float resizeCost, hashCost, labelCost, simplifyCost;
+
+  // Planes of each plane count used so far, kept so that returning to
+  // a level reuses the planes its retries settled on.
+  std::vector<std::vector<float> > planeSets;
+  int numChannels;
+
+  // The last frame and its codes, when segmented at reduced size.
+  cv::Mat scaledIn, scaledColor, scaledCodes;
+
+  float predict(const QualityLevel& q, size_t numPixels) const;
+  void chooseLevel(size_t numPixels);
+  void applyLevel(int next);
+  void fitCosts(const QualityLevel& q, size_t numPixels,
+                const StageTimings& t, bool keyFrame);
+
+  DeadlineSegmenter(const DeadlineSegmenter&);
+  DeadlineSegmenter& operator=(const DeadlineSegmenter&);
+};
+
+#endif /* end of include guard: DEADLINESEGMENTER_H_M8WQ4L2V */
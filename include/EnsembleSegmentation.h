@@ -0,0 +1,94 @@
+#ifndef ENSEMBLESEGMENTATION_H_8FJ2WQ5T
+#define ENSEMBLESEGMENTATION_H_8FJ2WQ5T
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
+#include "HammingHash.h"
+
+// One trial of an EnsembleSegmenter: a set of planes, the buffers it
+// is segmented with, and how its last segmentation scored.
+struct EnsembleTrial {
+  // Scratch space for hashing. Options such as streamProjections may
+  // be set here.
+  SegmentationContext ctx;
+
+  // The planes every segmentation starts from, and the planes the last
+  // one's retries ended with.
+  std::vector<float> startPlanes;
+  std::vector<float> planes;
+
+  // The region labels of the last segmentation.
+  cv::Mat labels;
+  int numMaxima, numComponents, numRegions;
+
+  // Fraction of region boundaries lying on color edges, fraction of
+  // color edges followed by a region boundary (to within a pixel), and
+  // their harmonic mean, which trials are ranked by.
+  float precision, recall, score;
+};
+
+/*
+ * An EnsembleSegmenter segments an image several times at once, each
+ * time from an independent set of random planes, and keeps the
+ * segmentation whose region boundaries best agree with the edges of
+ * the color image. This is the "repeated trials" a single run may
+ * call for, made in about the wall time of one run when there are at
+ * least as many cores as trials.
+ *
+ * Trials share the caller's converted input and one edge map of it,
+ * run on threads of their own, and keep their buffers from call to
+ * call. Each call starts every trial from the same planes and random
+ * stream, so that segmenting an image again gives the same result.
+ */
+class EnsembleSegmenter {
+public:
+  // [numTrials] trials hashing [numChannels]-channel images against
+  // [numPlanes] planes, with trial t's planes and retries drawn from
+  // stream t of [seed].
+  EnsembleSegmenter(int numTrials, int numPlanes, uint32_t hammingK,
+                    int maxRetries = 3, int numChannels = 3,
+                    uint64_t seed = RandomGenerator::DEFAULT_SEED);
+  ~EnsembleSegmenter();
+
+  // Segment [imgIn], the image that is hashed (e.g. HSV), into region
+  // labels in [labels] (CV_32S), with edges and simplification taken
+  // from [imgColor] (8-bit). Returns the best trial's region count as
+  // simplify does, or 0 if no trial found any Hamming maxima.
+  int segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+              cv::Mat& labels);
+
+  uint32_t hammingK;
+  int maxRetries;
+
+  // Whether trials are simplified before they are scored. Defaults to
+  // true.
+  bool simplify;
+
+  // Neighboring pixels lie across a color edge when the sum of their
+  // channels' absolute differences exceeds this multiple of its mean
+  // over the image (and at least [minEdgeContrast]). Defaults to 2 and
+  // 8.
+  float edgeScale;
+  int minEdgeContrast;
+
+  std::vector<EnsembleTrial*> trials;
+
+  // Index into [trials] of the last segmentation kept, or -1.
+  int bestTrial;
+
+private:
+  uint64_t seed;
+
+  // Whether each pixel lies across an edge from its right and lower
+  // neighbors (CV_8U).
+  cv::Mat edgesRight, edgesDown;
+
+  void findEdges(const cv::Mat& imgColor);
+  void runTrial(int t, const cv::Mat& imgIn, const cv::Mat& imgColor);
+  void scoreTrial(EnsembleTrial& trial) const;
+
+  EnsembleSegmenter(const EnsembleSegmenter&);
+  EnsembleSegmenter& operator=(const EnsembleSegmenter&);
+};
+
+#endif /* end of include guard: ENSEMBLESEGMENTATION_H_8FJ2WQ5T */
@@ -0,0 +1,171 @@
+#ifndef FRAMEQUEUE_H_J5PX2A9C
+#define FRAMEQUEUE_H_J5PX2A9C
+#include <vector>
+#include <sched.h>
+#include <pthread.h>
+
+// What FrameQueue::push does when the queue is full.
+enum QueueFullPolicy {
+  // Wait for the consumer to make room. Every item is delivered.
+  QUEUE_BLOCK = 0,
+
+  // Discard the item being pushed, so that a producer that must keep
+  // up with a live source (such as a camera) never falls behind.
+  QUEUE_DROP = 1
+};
+
+/*
+ * Lets threads sleep until something changes, such as an item being
+ * pushed to or popped from a FrameQueue. Every change advances an
+ * epoch; a waiter notes the epoch before checking whatever it waits
+ * for, and then sleeps only while the epoch stays the same, so no
+ * change can slip in between. Changes made while nobody sleeps cost
+ * one atomic add and never touch the lock.
+ */
+class QueueSignal {
+public:
+  QueueSignal() : epoch(0), sleepers(0) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+  ~QueueSignal() {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  // The current epoch, to be passed to wait().
+  unsigned int current() const {
+    return __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+  }
+
+  // Sleep until the epoch moves on from [seen], or until [cancel] (if
+  // not NULL) is set and wake() is called.
+  void wait(unsigned int seen, const int* cancel) {
+    pthread_mutex_lock(&mutex);
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    while(current() == seen &&
+          !(cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)))
+      pthread_cond_wait(&cond, &mutex);
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  // Advance the epoch, waking any sleepers.
+  void notify() {
+    __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST)) broadcast();
+  }
+
+  // Wake every sleeper, even if nothing changed. Call after setting a
+  // cancel flag that sleepers were given.
+  void wake() {
+    __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+    broadcast();
+  }
+
+private:
+  unsigned int epoch;
+  int sleepers;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  void broadcast() {
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  QueueSignal(const QueueSignal&);
+  QueueSignal& operator=(const QueueSignal&);
+};
+
+/*
+ * A bounded queue passing items from exactly one producer thread to
+ * exactly one consumer thread without locks. Each side owns one index
+ * into a ring of slots and only reads the other's, so a slot is never
+ * touched by both threads at once. A side that has to wait yields the
+ * CPU for a few rounds, in case the other side is about to catch up,
+ * and then sleeps on a QueueSignal until the other side pushes or
+ * pops. It gives up once the shared [cancel] flag is set and wake()
+ * is called.
+ */
+template<typename T>
+class FrameQueue {
+public:
+  // A queue of [capacity] items. Queues given the same [signal] wake
+  // each other's waiters, and a thread serving several of them can
+  // wait on it for any of them to change; otherwise the queue has a
+  // signal of its own.
+  explicit FrameQueue(int capacity, QueueSignal* signal = NULL)
+    : slots(capacity + 1), head(0), tail(0),
+      signal(signal ? signal : &ownSignal) {}
+
+  // Append [item]. Returns false if it was dropped under QUEUE_DROP,
+  // or if [cancel] (if not NULL) was set while waiting for room.
+  bool push(const T& item, QueueFullPolicy policy, const int* cancel) {
+    size_t t = tail;
+    size_t next = t + 1 == slots.size() ? 0 : t + 1;
+    for(int spins = 0; ; spins++) {
+      unsigned int seen = signal->current();
+      if(next != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) break;
+      if(policy == QUEUE_DROP ||
+         (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)))
+        return false;
+      if(spins < SPIN_ROUNDS) sched_yield();
+      else signal->wait(seen, cancel);
+    }
+    slots[t] = item;
+    __atomic_store_n(&tail, next, __ATOMIC_RELEASE);
+    signal->notify();
+    return true;
+  }
+
+  // Remove the oldest item into [item]. Returns false if the queue is
+  // empty and either [wait] is false or [cancel] (if not NULL) was
+  // set.
+  bool pop(T& item, bool wait, const int* cancel) {
+    size_t h = head;
+    for(int spins = 0; ; spins++) {
+      unsigned int seen = signal->current();
+      if(h != __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) break;
+      if(!wait || (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)))
+        return false;
+      if(spins < SPIN_ROUNDS) sched_yield();
+      else signal->wait(seen, cancel);
+    }
+    item = slots[h];
+    // Release whatever the slot holds (e.g. image buffers) now rather
+    // than when it is next overwritten.
+    slots[h] = T();
+    __atomic_store_n(&head, h + 1 == slots.size() ? 0 : h + 1,
+                     __ATOMIC_RELEASE);
+    signal->notify();
+    return true;
+  }
+
+  // Wake a side sleeping in push or pop, so that it sees a cancel flag
+  // that has just been set.
+  void wake() { signal->wake(); }
+
+private:
+  // Times a waiting side yields before it sleeps.
+  static const int SPIN_ROUNDS = 16;
+
+  // One slot more than the capacity, so that a full queue can be told
+  // from an empty one.
+  std::vector<T> slots;
+
+  // Next slot to pop (written by the consumer) and next slot to push
+  // (written by the producer). Each sits on a cache line of its own.
+  size_t head __attribute__((aligned(64)));
+  size_t tail __attribute__((aligned(64)));
+
+  // Where a waiting side sleeps.
+  QueueSignal ownSignal;
+  QueueSignal* signal;
+
+  FrameQueue(const FrameQueue&);
+  FrameQueue& operator=(const FrameQueue&);
+};
+
+#endif /* end of include guard: FRAMEQUEUE_H_J5PX2A9C */
@@ -0,0 +1,41 @@
+#ifndef HAMMINGDISTANCE_H_R2VQ8E6N
+#define HAMMINGDISTANCE_H_R2VQ8E6N
+#include <stdint.h>
+
+// Hamming distances between 64-bit codes, counted with population
+// count instructions. The CPU's POPCNT (or, better, AVX-512 VPOPCNTDQ,
+// which counts 8 codes per instruction) is used when available; the
+// portable form falls back on __builtin_popcountll.
+//
+// Only the sparse histogram's 64-bit codes need distances in bulk.
+// Dense codes of up to 32 bits never do: their maxima are found by
+// flipping bits directly and their nearest maxima by a flood over the
+// hypercube, so there are no scalar or 32-bit kernels.
+
+enum PopcountISA {
+  POPCOUNT_GENERIC = 0,
+  POPCOUNT_POPCNT = 1,
+  POPCOUNT_AVX512 = 2
+};
+
+// The best population count instructions supported by the running CPU.
+PopcountISA detectPopcountISA();
+
+// Store in distances[i] the Hamming distance from [code] to codes[i],
+// for [n] codes.
+typedef void (*HammingDistances64Fn)(uint64_t code, const uint64_t* codes,
+                                     int n, uint8_t* distances);
+
+struct HammingDistanceKernels {
+  HammingDistances64Fn distances64;
+};
+
+// Kernels for the given instructions. Requesting instructions the CPU
+// does not support yields the best ones it does.
+const HammingDistanceKernels& hammingDistanceKernels(PopcountISA isa);
+
+// Kernels for the best instructions the running CPU supports, which
+// are only detected once.
+const HammingDistanceKernels& hammingDistanceKernels();
+
+#endif /* end of include guard: HAMMINGDISTANCE_H_R2VQ8E6N */
@@ -0,0 +1,286 @@
+#ifndef HAMMINGHASH_H_QW3NV81K
+#define HAMMINGHASH_H_QW3NV81K
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
+#include "ProjectionKernels.h"
+#include "HammingNeighborhood.h"
+#include "SparseHistogram.h"
+#include "RandomGenerator.h"
+
+// Scratch space used to map codes to their nearest Hamming maxima.
+struct MaximaSearch {
+  // One bit per code, set for the maxima while a search is under way
+  // and clear otherwise.
+  std::vector<uint64_t> maximaBits;
+
+  // Distance from each code to its nearest maximum, and the queue of
+  // the hypercube flood that computes them.
+  std::vector<uint8_t> distances;
+  std::vector<uint32_t> queue;
+};
+
+// Seconds spent in each stage of hammingHash, summed over calls.
+struct HashStageTimes {
+  // Projecting pixels onto the planes (or, when projections are
+  // streamed, finding their extrema).
+  double project;
+  // Encoding projections and counting the codes.
+  double encode;
+  // Finding Hamming maxima.
+  double maxima;
+  // Mapping codes to maxima and writing the coded image.
+  double map;
+};
+
+// Scratch storage used by hammingHash. A context owns every buffer
+// whose size depends on the frame dimensions or on the number of
+// splitting planes. Buffers are grown to fit the largest request seen
+// so far and are reused as-is for anything smaller. A context must
+// only be used by one thread at a time; concurrent segmentations
+// (e.g. one per camera stream or per batch worker) should each own a
+// context of their own.
+class SegmentationContext {
+public:
+  SegmentationContext();
+  ~SegmentationContext();
+
+  // Make room for a [rows] x [cols] frame hashed against [numPlanes]
+  // planes. Nothing is reallocated unless the request exceeds what
+  // has already been allocated.
+  void reserve(int rows, int cols, int numPlanes);
+
+  // Bytes held by the context's buffers (not counting the entries of
+  // sparse histograms).
+  size_t allocatedBytes() const;
+
+  // Instruction set used for projection and encoding. Defaults to the
+  // best one the CPU supports; lower it to compare against the scalar
+  // kernels.
+  ProjectionISA isa;
+
+  // When true, hashing makes two passes over the image: the first
+  // finds the extrema of each plane's projections, the second
+  // recomputes each projection as it is encoded. This trades a second
+  // round of dot products for never storing [projections], which is
+  // the largest allocation in the pipeline (and most of its memory
+  // traffic) at high resolutions. Off by default.
+  bool streamProjections;
+
+  // When true, projections are computed from per-channel lookup
+  // tables of quantized plane contributions (see ProjectionTable)
+  // using only integer adds, and are stored as int16_t. Only valid for
+  // 8-bit inputs. Codes may differ slightly from the floating point
+  // path where a projection lies within quantization error of its
+  // plane's midpoint. Off by default.
+  bool integerProjections;
+
+  // The most planes hashed with a dense histogram of 1 << numPlanes
+  // bins. Above this (and up to 64 planes) codes are 64 bits wide and
+  // are counted in a SparseHistogram, projections are always
+  // streamed, and [integerProjections] is ignored. The coded image
+  // then holds the index of each pixel's maximum rather than its
+  // code. Defaults to 20.
+  int maxDensePlanes;
+
+  // The most planes for which each encoding thread counts codes in a
+  // dense histogram of its own, which costs maxThreads * (1 <<
+  // numPlanes) * 28 bytes (about 29 MB for 16 threads at the default
+  // of 16). Between this and [maxDensePlanes], threads count their
+  // codes in sparse histograms instead, and only the shared histogram
+  // is dense.
+  int maxThreadBinPlanes;
+
+  // When true, the time spent in each stage of hammingHash is added to
+  // [stageTimes], which the caller is free to reset. Off by default.
+  bool timeStages;
+  HashStageTimes stageTimes;
+
+  // Draws the planes that replace bad ones when hashing retries.
+  // Seeded with RandomGenerator::DEFAULT_SEED; reseed it to vary or
+  // reproduce the retries of a segmentation.
+  RandomGenerator rng;
+
+  // Per-pixel, per-plane projections (rows*cols*numPlanes), as floats
+  // or, when [integerProjections] is set, as int16_t. Left
+  // unallocated when [streamProjections] is set.
+  float* projections;
+  int16_t* intProjections;
+
+  // Histogram of Hamming codes, its mapping to Hamming maxima, and
+  // the summed color of the pixels in each bin (3 per bin). [bins] is
+  // always sized to exactly 1 << numPlanes.
+  std::vector<uint32_t> bins;
+
+  // The occupied entries of [bins], in ascending order. Every entry of
+  // [bins] not listed here is zero, and the other per-code arrays are
+  // only meaningful for listed codes, so stages that only care about
+  // occupied codes need never walk or clear the whole histogram.
+  std::vector<uint32_t> activeBins;
+  uint32_t* binMapping;
+  float* binColors;
+
+  // The splitting planes currently being hashed against, arranged for
+  // the projection kernels.
+  PlaneLayout layout;
+
+  // Lookup tables used when [integerProjections] is set. Kept across
+  // calls, so that only planes that were replaced get rebuilt.
+  ProjectionTable table;
+
+  // Neighbor masks used to find Hamming maxima at larger radii.
+  HammingNeighborhood neighborhood;
+
+  // Scratch space for mapping codes to their nearest maxima.
+  MaximaSearch search;
+
+  // Private code histograms and color sums, one of each per thread,
+  // filled while encoding and then reduced into [bins] and
+  // [binColors]. Only used up to [maxThreadBinPlanes] planes.
+  std::vector<uint32_t> threadBins;
+  std::vector<uint64_t> threadColorSums;
+
+  // The codes each thread saw while encoding.
+  std::vector<std::vector<uint32_t> > threadActiveBins;
+
+  // State used above [maxDensePlanes]: each pixel's 64-bit code, the
+  // splitting planes beyond the 32 held by [layout], the histogram of
+  // codes and one private histogram per thread (also used by encoding
+  // above [maxThreadBinPlanes]), and the index of the maximum each
+  // histogram entry maps to.
+  std::vector<uint64_t> wideCodes;
+  PlaneLayout highLayout;
+  SparseHistogram sparseBins;
+  std::vector<SparseHistogram> threadSparseBins;
+  std::vector<uint32_t> sparseMapping;
+
+private:
+  size_t projectionsCapacity;
+  size_t intProjectionsCapacity;
+  size_t binCapacity;
+
+  // A context owns raw buffers, so it may not be copied.
+  SegmentationContext(const SegmentationContext&);
+  SegmentationContext& operator=(const SegmentationContext&);
+};
+
+// Produce [numPlanes] random vectors, each of dimension [numDimensions],
+// drawn from [rng].
+std::vector<float> makeRandomPlanes(int numPlanes, int numDimensions,
+                                    RandomGenerator& rng);
+
+// Compute the Hamming code of each pixel of [imgIn], and map each
+// code to its nearest Hamming-space [hammingK]-maximum. The coded
+// image is stored in [imgOut] (CV_32S). Returns the number of maxima
+// found, or zero if none were (or if there are more than 64
+// planes). All scratch space is taken from [ctx], and planes replaced
+// on a retry are drawn from ctx.rng.
+int hammingHash(SegmentationContext& ctx,
+                const cv::Mat& imgIn, cv::Mat& imgOut,
+                std::vector<float>& planes,
+                uint32_t hammingK,
+                int maxRetries = 5);
+
+// As above, but using a context shared by every caller of this
+// overload. Not reentrant.
+int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
+                std::vector<float>& planes,
+                uint32_t hammingK,
+                int maxRetries = 5);
+
+// Hashes a stream of similar frames, such as video, carrying state
+// from one frame to the next. Each key frame is hashed in full by
+// hammingHash, and its planes, per-plane midpoints, maxima and
+// code-to-maximum mapping are kept. Following frames are encoded
+// against the same midpoints in a single pass; as long as their
+// histograms stay within [maxHistogramChange] of the key frame's, the
+// retries, the maxima search and the mapping are skipped, and only
+// codes not seen since the key frame are mapped to a maximum. A frame
+// that changes more (e.g. a scene cut) becomes the next key frame.
+//
+// Frames hashed with a sparse histogram (see
+// SegmentationContext::maxDensePlanes) are always key frames.
+class SegmentationSession {
+public:
+  SegmentationSession(const std::vector<float>& planes,
+                      uint32_t hammingK,
+                      int maxRetries = 5);
+
+  // A session hashing [numChannels]-channel frames against [numPlanes]
+  // random planes, with ctx.rng seeded by [seed] (and [stream]) and
+  // the planes drawn from it, so that the seed determines every plane
+  // the session uses.
+  SegmentationSession(int numPlanes, int numChannels,
+                      uint32_t hammingK, int maxRetries,
+                      uint64_t seed, uint64_t stream = 0);
+
+  // As hammingHash, for the next frame of the stream.
+  int hash(const cv::Mat& imgIn, cv::Mat& imgOut);
+
+  // Hash a frame that differs from the last one only within [blocks],
+  // which must not overlap. [prevIn] holds the pixels last hashed
+  // (the previous frame, at least within the blocks) and [imgOut] the
+  // coded image they produced; only the blocks of [imgOut] are
+  // rewritten, and the histogram is patched rather than rebuilt.
+  // Returns false if the frame cannot reuse the key frame (as when the
+  // patched histogram has drifted too far from it), in which case the
+  // whole frame should be passed to hash().
+  bool hashBlocks(const cv::Mat& prevIn,
+                  const cv::Mat& imgIn, cv::Mat& imgOut,
+                  const std::vector<cv::Rect>& blocks);
+
+  // Forget the key frame, so that the next frame is hashed afresh.
+  // Needed after changing [planes] or [hammingK].
+  void reset();
+
+  // Scratch space and options (such as integerProjections) used for
+  // every frame.
+  SegmentationContext ctx;
+
+  // The planes hashed against. Updated whenever a key frame replaces
+  // some of them.
+  std::vector<float> planes;
+  uint32_t hammingK;
+  int maxRetries;
+
+  // The largest fraction of pixels whose codes may differ from the key
+  // frame's histogram before a new key frame is taken. Defaults to
+  // 0.1.
+  float maxHistogramChange;
+
+  // Take a key frame at least this often, so that the midpoints track
+  // slow drift. Defaults to 60 frames.
+  int keyFrameInterval;
+
+  // Whether the last frame reused the key frame's maxima, and its
+  // histogram's change from the key frame's (zero for a key frame).
+  bool lastFrameWarm;
+  float lastHistogramChange;
+
+private:
+  bool hasKeyFrame;
+  int framesSinceKey;
+  uint32_t keyStamp;
+  int keyRows, keyCols, keyType;
+
+  // The key frame's histogram (before mapping) and its occupied codes.
+  std::vector<uint32_t> keyBins;
+  std::vector<uint32_t> keyActive;
+
+  // The key frame's maxima and their mean colors.
+  std::vector<uint32_t> maxima;
+  std::vector<float> maximaColors;
+
+  // Codes whose entry equals [keyStamp] have a valid mapping in
+  // ctx.binMapping.
+  std::vector<uint32_t> mappedStamp;
+
+  void rememberKeyFrame(const cv::Mat& imgIn);
+  void mapUnseenCodes(const uint32_t* codes, size_t n, int numPlanes);
+  float histogramChange(size_t numPixels) const;
+
+  SegmentationSession(const SegmentationSession&);
+  SegmentationSession& operator=(const SegmentationSession&);
+};
+
+#endif /* end of include guard: HAMMINGHASH_H_QW3NV81K */
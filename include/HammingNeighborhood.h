@@ -0,0 +1,66 @@
+#ifndef HAMMINGNEIGHBORHOOD_H_L5PZ0QRC
+#define HAMMINGNEIGHBORHOOD_H_L5PZ0QRC
+#include <vector>
+#include <stdint.h>
+
+/*
+ * A HammingNeighborhood stores hamming-adjacency information for
+ * N-bit codes out to some radius K. The counts array stores the number
+ * of neighbors at each distance. For example, 3-bit codes have 3
+ * neighbors with distance 1, 3 neighbors with distance 2, and 1
+ * neighbor with distance 3. The masks array then encodes the
+ * adjacency information in terms of bitmasks to compute neighbors of
+ * a given code. For instance, to compute the 1-neighbors of the 3-bit
+ * code 010, we XOR the code with 4 (100) to yield 110, then with 2
+ * (010) to yield 000, and finally with 1 (001) to yield 011. These
+ * are the 3 1-bit distant neighbors of 010.
+ *
+ * The masks are all the one-bit numbers of the given bit-length, then
+ * all the two-bit numbers, and so on, each group in descending
+ * order. For instance, an 8-bit representation of 15 is 00001111,
+ * which may be used to compute a 4-neighbor of a code via an XOR
+ * operation (e.g. 11000010 XOR 00001111 = 11001101 which has 4 bits
+ * flipped from the code 11000010).
+ *
+ * Masks are generated on demand rather than precomputed, so any code
+ * length up to 31 bits and any radius are available. Note that the
+ * number of masks grows as the sum of binomial coefficients
+ * C(N,1) + ... + C(N,K). Growing the radius only generates the new
+ * distances, and the tables of each code length are kept, so callers
+ * that widen their search one distance at a time, or that alternate
+ * between code lengths, generate each mask once.
+ */
+class HammingNeighborhood {
+public:
+  HammingNeighborhood() : numBits(0), radius(0) {}
+
+  // Make sure masks are available for [bits]-bit codes out to
+  // distance [k] (which is clamped to [bits]). Masks already generated
+  // for this code length are reused, and only the distances beyond
+  // them are added.
+  void generate(int bits, int k);
+
+  // Number of masks within distance [k] of a code, i.e. the length of
+  // the prefix of [masks] that covers distances 1 through [k].
+  uint32_t countWithin(int k) const;
+
+  int numBits;
+  int radius;
+
+  // counts[d-1] is the number of neighbors at distance d.
+  std::vector<uint32_t> counts;
+  std::vector<uint32_t> masks;
+
+private:
+  // The tables of the other code lengths generated so far, indexed by
+  // code length. The current tables are swapped in and out of here.
+  struct Tables {
+    Tables() : radius(0) {}
+    int radius;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> masks;
+  };
+  std::vector<Tables> stored;
+};
+
+#endif /* end of include guard: HAMMINGNEIGHBORHOOD_H_L5PZ0QRC */
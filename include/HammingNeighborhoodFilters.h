@@ -1,526 +0,0 @@
-#ifndef HAMMINGNEIGHBORHOODFILTERS_H_S0TIKDI9
-#define HAMMINGNEIGHBORHOODFILTERS_H_S0TIKDI9
-#include <stdint.h>
-
-/*
- * These filters store precomputed hamming-adjacency information. The
- * filterCountsN arrays store the number of K-neighbors for N-bit
- * codes. For example, filterCounts3 says that 3-bit codes have 3
- * neighbors with distance 1, 3 neighbors with distance 2, and 1
- * neighbor with distance 3. The filterN arrays then encode the
- * adjacency information in terms of bitmasks to compute neighbors of
- * a given code. For instance, to compute the 1-neighbors of the 3-bit
- * code 010, we XOR the code with 4 (100) to yield 110, then with 2
- * (010) to yield 000, and finally with 1 (001) to yield 011. These
- * are the 3 1-bit distanct neighbors of 010.
- *
- * The arrays are computed by considering all the one-bit numbers of
- * the given bit-length, then all the two-bit numbers, and so on. For
- * instance, an 8-bit representation of 15 is 00001111, which may be
- * used to compute a 4-neighbor of a code via an XOR operation
- * (e.g. 11000010 XOR 00001111 = 11001101 which has 4 bits flipped
- * from the code 11000010).
- */
-
-uint32_t filterCounts3[] = {3, 3, 1};
-uint32_t filter3[] = {4, 2, 1, 6, 5, 3, 7
-};
-
-uint32_t filterCounts8[] = {8, 28, 56, 70};
-uint32_t filter8[] = {128, 64, 32, 16, 8, 4, 2, 1, 192, 160, 
-144, 136, 132, 130, 129, 96, 80, 72, 68, 66, 
-65, 48, 40, 36, 34, 33, 24, 20, 18, 17, 
-12, 10, 9, 6, 5, 3, 224, 208, 200, 196, 
-194, 193, 176, 168, 164, 162, 161, 152, 148, 146, 
-145, 140, 138, 137, 134, 133, 131, 112, 104, 100, 
-98, 97, 88, 84, 82, 81, 76, 74, 73, 70, 
-69, 67, 56, 52, 50, 49, 44, 42, 41, 38, 
-37, 35, 28, 26, 25, 22, 21, 19, 14, 13, 
-11, 7, 240, 232, 228, 226, 225, 216, 212, 210, 
-209, 204, 202, 201, 198, 197, 195, 184, 180, 178, 
-177, 172, 170, 169, 166, 165, 163, 156, 154, 153, 
-150, 149, 147, 142, 141, 139, 135, 120, 116, 114, 
-113, 108, 106, 105, 102, 101, 99, 92, 90, 89, 
-86, 85, 83, 78, 77, 75, 71, 60, 58, 57, 
-54, 53, 51, 46, 45, 43, 39, 30, 29, 27, 
-23, 15
-};
-
-uint32_t filterCounts9[] = {9, 36, 84, 126};
-uint32_t filter9[] = {256, 128, 64, 32, 16, 8, 4, 2, 1, 384, 
-320, 288, 272, 264, 260, 258, 257, 192, 160, 144, 
-136, 132, 130, 129, 96, 80, 72, 68, 66, 65, 
-48, 40, 36, 34, 33, 24, 20, 18, 17, 12, 
-10, 9, 6, 5, 3, 448, 416, 400, 392, 388, 
-386, 385, 352, 336, 328, 324, 322, 321, 304, 296, 
-292, 290, 289, 280, 276, 274, 273, 268, 266, 265, 
-262, 261, 259, 224, 208, 200, 196, 194, 193, 176, 
-168, 164, 162, 161, 152, 148, 146, 145, 140, 138, 
-137, 134, 133, 131, 112, 104, 100, 98, 97, 88, 
-84, 82, 81, 76, 74, 73, 70, 69, 67, 56, 
-52, 50, 49, 44, 42, 41, 38, 37, 35, 28, 
-26, 25, 22, 21, 19, 14, 13, 11, 7, 480, 
-464, 456, 452, 450, 449, 432, 424, 420, 418, 417, 
-408, 404, 402, 401, 396, 394, 393, 390, 389, 387, 
-368, 360, 356, 354, 353, 344, 340, 338, 337, 332, 
-330, 329, 326, 325, 323, 312, 308, 306, 305, 300, 
-298, 297, 294, 293, 291, 284, 282, 281, 278, 277, 
-275, 270, 269, 267, 263, 240, 232, 228, 226, 225, 
-216, 212, 210, 209, 204, 202, 201, 198, 197, 195, 
-184, 180, 178, 177, 172, 170, 169, 166, 165, 163, 
-156, 154, 153, 150, 149, 147, 142, 141, 139, 135, 
-120, 116, 114, 113, 108, 106, 105, 102, 101, 99, 
-92, 90, 89, 86, 85, 83, 78, 77, 75, 71, 
-60, 58, 57, 54, 53, 51, 46, 45, 43, 39, 
-30, 29, 27, 23, 15
-};
-
-uint32_t filterCounts10[] = {10, 45, 120, 210};
-uint32_t filter10[] = {512, 256, 128, 64, 32, 16, 8, 4, 2, 1, 
-768, 640, 576, 544, 528, 520, 516, 514, 513, 384, 
-320, 288, 272, 264, 260, 258, 257, 192, 160, 144, 
-136, 132, 130, 129, 96, 80, 72, 68, 66, 65, 
-48, 40, 36, 34, 33, 24, 20, 18, 17, 12, 
-10, 9, 6, 5, 3, 896, 832, 800, 784, 776, 
-772, 770, 769, 704, 672, 656, 648, 644, 642, 641, 
-608, 592, 584, 580, 578, 577, 560, 552, 548, 546, 
-545, 536, 532, 530, 529, 524, 522, 521, 518, 517, 
-515, 448, 416, 400, 392, 388, 386, 385, 352, 336, 
-328, 324, 322, 321, 304, 296, 292, 290, 289, 280, 
-276, 274, 273, 268, 266, 265, 262, 261, 259, 224, 
-208, 200, 196, 194, 193, 176, 168, 164, 162, 161, 
-152, 148, 146, 145, 140, 138, 137, 134, 133, 131, 
-112, 104, 100, 98, 97, 88, 84, 82, 81, 76, 
-74, 73, 70, 69, 67, 56, 52, 50, 49, 44, 
-42, 41, 38, 37, 35, 28, 26, 25, 22, 21, 
-19, 14, 13, 11, 7, 960, 928, 912, 904, 900, 
-898, 897, 864, 848, 840, 836, 834, 833, 816, 808, 
-804, 802, 801, 792, 788, 786, 785, 780, 778, 777, 
-774, 773, 771, 736, 720, 712, 708, 706, 705, 688, 
-680, 676, 674, 673, 664, 660, 658, 657, 652, 650, 
-649, 646, 645, 643, 624, 616, 612, 610, 609, 600, 
-596, 594, 593, 588, 586, 585, 582, 581, 579, 568, 
-564, 562, 561, 556, 554, 553, 550, 549, 547, 540, 
-538, 537, 534, 533, 531, 526, 525, 523, 519, 480, 
-464, 456, 452, 450, 449, 432, 424, 420, 418, 417, 
-408, 404, 402, 401, 396, 394, 393, 390, 389, 387, 
-368, 360, 356, 354, 353, 344, 340, 338, 337, 332, 
-330, 329, 326, 325, 323, 312, 308, 306, 305, 300, 
-298, 297, 294, 293, 291, 284, 282, 281, 278, 277, 
-275, 270, 269, 267, 263, 240, 232, 228, 226, 225, 
-216, 212, 210, 209, 204, 202, 201, 198, 197, 195, 
-184, 180, 178, 177, 172, 170, 169, 166, 165, 163, 
-156, 154, 153, 150, 149, 147, 142, 141, 139, 135, 
-120, 116, 114, 113, 108, 106, 105, 102, 101, 99, 
-92, 90, 89, 86, 85, 83, 78, 77, 75, 71, 
-60, 58, 57, 54, 53, 51, 46, 45, 43, 39, 
-30, 29, 27, 23, 15
-};
-
-uint32_t filterCounts11[] = {11, 55, 165, 330};
-uint32_t filter11[] = {1024, 512, 256, 128, 64, 32, 16, 8, 4, 2, 
-1, 1536, 1280, 1152, 1088, 1056, 1040, 1032, 1028, 1026, 
-1025, 768, 640, 576, 544, 528, 520, 516, 514, 513, 
-384, 320, 288, 272, 264, 260, 258, 257, 192, 160, 
-144, 136, 132, 130, 129, 96, 80, 72, 68, 66, 
-65, 48, 40, 36, 34, 33, 24, 20, 18, 17, 
-12, 10, 9, 6, 5, 3, 1792, 1664, 1600, 1568, 
-1552, 1544, 1540, 1538, 1537, 1408, 1344, 1312, 1296, 1288, 
-1284, 1282, 1281, 1216, 1184, 1168, 1160, 1156, 1154, 1153, 
-1120, 1104, 1096, 1092, 1090, 1089, 1072, 1064, 1060, 1058, 
-1057, 1048, 1044, 1042, 1041, 1036, 1034, 1033, 1030, 1029, 
-1027, 896, 832, 800, 784, 776, 772, 770, 769, 704, 
-672, 656, 648, 644, 642, 641, 608, 592, 584, 580, 
-578, 577, 560, 552, 548, 546, 545, 536, 532, 530, 
-529, 524, 522, 521, 518, 517, 515, 448, 416, 400, 
-392, 388, 386, 385, 352, 336, 328, 324, 322, 321, 
-304, 296, 292, 290, 289, 280, 276, 274, 273, 268, 
-266, 265, 262, 261, 259, 224, 208, 200, 196, 194, 
-193, 176, 168, 164, 162, 161, 152, 148, 146, 145, 
-140, 138, 137, 134, 133, 131, 112, 104, 100, 98, 
-97, 88, 84, 82, 81, 76, 74, 73, 70, 69, 
-67, 56, 52, 50, 49, 44, 42, 41, 38, 37, 
-35, 28, 26, 25, 22, 21, 19, 14, 13, 11, 
-7, 1920, 1856, 1824, 1808, 1800, 1796, 1794, 1793, 1728, 
-1696, 1680, 1672, 1668, 1666, 1665, 1632, 1616, 1608, 1604, 
-1602, 1601, 1584, 1576, 1572, 1570, 1569, 1560, 1556, 1554, 
-1553, 1548, 1546, 1545, 1542, 1541, 1539, 1472, 1440, 1424, 
-1416, 1412, 1410, 1409, 1376, 1360, 1352, 1348, 1346, 1345, 
-1328, 1320, 1316, 1314, 1313, 1304, 1300, 1298, 1297, 1292, 
-1290, 1289, 1286, 1285, 1283, 1248, 1232, 1224, 1220, 1218, 
-1217, 1200, 1192, 1188, 1186, 1185, 1176, 1172, 1170, 1169, 
-1164, 1162, 1161, 1158, 1157, 1155, 1136, 1128, 1124, 1122, 
-1121, 1112, 1108, 1106, 1105, 1100, 1098, 1097, 1094, 1093, 
-1091, 1080, 1076, 1074, 1073, 1068, 1066, 1065, 1062, 1061, 
-1059, 1052, 1050, 1049, 1046, 1045, 1043, 1038, 1037, 1035, 
-1031, 960, 928, 912, 904, 900, 898, 897, 864, 848, 
-840, 836, 834, 833, 816, 808, 804, 802, 801, 792, 
-788, 786, 785, 780, 778, 777, 774, 773, 771, 736, 
-720, 712, 708, 706, 705, 688, 680, 676, 674, 673, 
-664, 660, 658, 657, 652, 650, 649, 646, 645, 643, 
-624, 616, 612, 610, 609, 600, 596, 594, 593, 588, 
-586, 585, 582, 581, 579, 568, 564, 562, 561, 556, 
-554, 553, 550, 549, 547, 540, 538, 537, 534, 533, 
-531, 526, 525, 523, 519, 480, 464, 456, 452, 450, 
-449, 432, 424, 420, 418, 417, 408, 404, 402, 401, 
-396, 394, 393, 390, 389, 387, 368, 360, 356, 354, 
-353, 344, 340, 338, 337, 332, 330, 329, 326, 325, 
-323, 312, 308, 306, 305, 300, 298, 297, 294, 293, 
-291, 284, 282, 281, 278, 277, 275, 270, 269, 267, 
-263, 240, 232, 228, 226, 225, 216, 212, 210, 209, 
-204, 202, 201, 198, 197, 195, 184, 180, 178, 177, 
-172, 170, 169, 166, 165, 163, 156, 154, 153, 150, 
-149, 147, 142, 141, 139, 135, 120, 116, 114, 113, 
-108, 106, 105, 102, 101, 99, 92, 90, 89, 86, 
-85, 83, 78, 77, 75, 71, 60, 58, 57, 54, 
-53, 51, 46, 45, 43, 39, 30, 29, 27, 23, 
-15
-};
-
-uint32_t filterCounts12[] = {12, 66, 220, 495};
-uint32_t filter12[] = {2048, 1024, 512, 256, 128, 64, 32, 16, 8, 4, 
-2, 1, 3072, 2560, 2304, 2176, 2112, 2080, 2064, 2056, 
-2052, 2050, 2049, 1536, 1280, 1152, 1088, 1056, 1040, 1032, 
-1028, 1026, 1025, 768, 640, 576, 544, 528, 520, 516, 
-514, 513, 384, 320, 288, 272, 264, 260, 258, 257, 
-192, 160, 144, 136, 132, 130, 129, 96, 80, 72, 
-68, 66, 65, 48, 40, 36, 34, 33, 24, 20, 
-18, 17, 12, 10, 9, 6, 5, 3, 3584, 3328, 
-3200, 3136, 3104, 3088, 3080, 3076, 3074, 3073, 2816, 2688, 
-2624, 2592, 2576, 2568, 2564, 2562, 2561, 2432, 2368, 2336, 
-2320, 2312, 2308, 2306, 2305, 2240, 2208, 2192, 2184, 2180, 
-2178, 2177, 2144, 2128, 2120, 2116, 2114, 2113, 2096, 2088, 
-2084, 2082, 2081, 2072, 2068, 2066, 2065, 2060, 2058, 2057, 
-2054, 2053, 2051, 1792, 1664, 1600, 1568, 1552, 1544, 1540, 
-1538, 1537, 1408, 1344, 1312, 1296, 1288, 1284, 1282, 1281, 
-1216, 1184, 1168, 1160, 1156, 1154, 1153, 1120, 1104, 1096, 
-1092, 1090, 1089, 1072, 1064, 1060, 1058, 1057, 1048, 1044, 
-1042, 1041, 1036, 1034, 1033, 1030, 1029, 1027, 896, 832, 
-800, 784, 776, 772, 770, 769, 704, 672, 656, 648, 
-644, 642, 641, 608, 592, 584, 580, 578, 577, 560, 
-552, 548, 546, 545, 536, 532, 530, 529, 524, 522, 
-521, 518, 517, 515, 448, 416, 400, 392, 388, 386, 
-385, 352, 336, 328, 324, 322, 321, 304, 296, 292, 
-290, 289, 280, 276, 274, 273, 268, 266, 265, 262, 
-261, 259, 224, 208, 200, 196, 194, 193, 176, 168, 
-164, 162, 161, 152, 148, 146, 145, 140, 138, 137, 
-134, 133, 131, 112, 104, 100, 98, 97, 88, 84, 
-82, 81, 76, 74, 73, 70, 69, 67, 56, 52, 
-50, 49, 44, 42, 41, 38, 37, 35, 28, 26, 
-25, 22, 21, 19, 14, 13, 11, 7, 3840, 3712, 
-3648, 3616, 3600, 3592, 3588, 3586, 3585, 3456, 3392, 3360, 
-3344, 3336, 3332, 3330, 3329, 3264, 3232, 3216, 3208, 3204, 
-3202, 3201, 3168, 3152, 3144, 3140, 3138, 3137, 3120, 3112, 
-3108, 3106, 3105, 3096, 3092, 3090, 3089, 3084, 3082, 3081, 
-3078, 3077, 3075, 2944, 2880, 2848, 2832, 2824, 2820, 2818, 
-2817, 2752, 2720, 2704, 2696, 2692, 2690, 2689, 2656, 2640, 
-2632, 2628, 2626, 2625, 2608, 2600, 2596, 2594, 2593, 2584, 
-2580, 2578, 2577, 2572, 2570, 2569, 2566, 2565, 2563, 2496, 
-2464, 2448, 2440, 2436, 2434, 2433, 2400, 2384, 2376, 2372, 
-2370, 2369, 2352, 2344, 2340, 2338, 2337, 2328, 2324, 2322, 
-2321, 2316, 2314, 2313, 2310, 2309, 2307, 2272, 2256, 2248, 
-2244, 2242, 2241, 2224, 2216, 2212, 2210, 2209, 2200, 2196, 
-2194, 2193, 2188, 2186, 2185, 2182, 2181, 2179, 2160, 2152, 
-2148, 2146, 2145, 2136, 2132, 2130, 2129, 2124, 2122, 2121, 
-2118, 2117, 2115, 2104, 2100, 2098, 2097, 2092, 2090, 2089, 
-2086, 2085, 2083, 2076, 2074, 2073, 2070, 2069, 2067, 2062, 
-2061, 2059, 2055, 1920, 1856, 1824, 1808, 1800, 1796, 1794, 
-1793, 1728, 1696, 1680, 1672, 1668, 1666, 1665, 1632, 1616, 
-1608, 1604, 1602, 1601, 1584, 1576, 1572, 1570, 1569, 1560, 
-1556, 1554, 1553, 1548, 1546, 1545, 1542, 1541, 1539, 1472, 
-1440, 1424, 1416, 1412, 1410, 1409, 1376, 1360, 1352, 1348, 
-1346, 1345, 1328, 1320, 1316, 1314, 1313, 1304, 1300, 1298, 
-1297, 1292, 1290, 1289, 1286, 1285, 1283, 1248, 1232, 1224, 
-1220, 1218, 1217, 1200, 1192, 1188, 1186, 1185, 1176, 1172, 
-1170, 1169, 1164, 1162, 1161, 1158, 1157, 1155, 1136, 1128, 
-1124, 1122, 1121, 1112, 1108, 1106, 1105, 1100, 1098, 1097, 
-1094, 1093, 1091, 1080, 1076, 1074, 1073, 1068, 1066, 1065, 
-1062, 1061, 1059, 1052, 1050, 1049, 1046, 1045, 1043, 1038, 
-1037, 1035, 1031, 960, 928, 912, 904, 900, 898, 897, 
-864, 848, 840, 836, 834, 833, 816, 808, 804, 802, 
-801, 792, 788, 786, 785, 780, 778, 777, 774, 773, 
-771, 736, 720, 712, 708, 706, 705, 688, 680, 676, 
-674, 673, 664, 660, 658, 657, 652, 650, 649, 646, 
-645, 643, 624, 616, 612, 610, 609, 600, 596, 594, 
-593, 588, 586, 585, 582, 581, 579, 568, 564, 562, 
-561, 556, 554, 553, 550, 549, 547, 540, 538, 537, 
-534, 533, 531, 526, 525, 523, 519, 480, 464, 456, 
-452, 450, 449, 432, 424, 420, 418, 417, 408, 404, 
-402, 401, 396, 394, 393, 390, 389, 387, 368, 360, 
-356, 354, 353, 344, 340, 338, 337, 332, 330, 329, 
-326, 325, 323, 312, 308, 306, 305, 300, 298, 297, 
-294, 293, 291, 284, 282, 281, 278, 277, 275, 270, 
-269, 267, 263, 240, 232, 228, 226, 225, 216, 212, 
-210, 209, 204, 202, 201, 198, 197, 195, 184, 180, 
-178, 177, 172, 170, 169, 166, 165, 163, 156, 154, 
-153, 150, 149, 147, 142, 141, 139, 135, 120, 116, 
-114, 113, 108, 106, 105, 102, 101, 99, 92, 90, 
-89, 86, 85, 83, 78, 77, 75, 71, 60, 58, 
-57, 54, 53, 51, 46, 45, 43, 39, 30, 29, 
-27, 23, 15
-};
-
-uint32_t filterCounts13[] = {13, 78, 286, 715};
-uint32_t filter13[] = {4096, 2048, 1024, 512, 256, 128, 64, 32, 16, 8, 
-4, 2, 1, 6144, 5120, 4608, 4352, 4224, 4160, 4128, 
-4112, 4104, 4100, 4098, 4097, 3072, 2560, 2304, 2176, 2112, 
-2080, 2064, 2056, 2052, 2050, 2049, 1536, 1280, 1152, 1088, 
-1056, 1040, 1032, 1028, 1026, 1025, 768, 640, 576, 544, 
-528, 520, 516, 514, 513, 384, 320, 288, 272, 264, 
-260, 258, 257, 192, 160, 144, 136, 132, 130, 129, 
-96, 80, 72, 68, 66, 65, 48, 40, 36, 34, 
-33, 24, 20, 18, 17, 12, 10, 9, 6, 5, 
-3, 7168, 6656, 6400, 6272, 6208, 6176, 6160, 6152, 6148, 
-6146, 6145, 5632, 5376, 5248, 5184, 5152, 5136, 5128, 5124, 
-5122, 5121, 4864, 4736, 4672, 4640, 4624, 4616, 4612, 4610, 
-4609, 4480, 4416, 4384, 4368, 4360, 4356, 4354, 4353, 4288, 
-4256, 4240, 4232, 4228, 4226, 4225, 4192, 4176, 4168, 4164, 
-4162, 4161, 4144, 4136, 4132, 4130, 4129, 4120, 4116, 4114, 
-4113, 4108, 4106, 4105, 4102, 4101, 4099, 3584, 3328, 3200, 
-3136, 3104, 3088, 3080, 3076, 3074, 3073, 2816, 2688, 2624, 
-2592, 2576, 2568, 2564, 2562, 2561, 2432, 2368, 2336, 2320, 
-2312, 2308, 2306, 2305, 2240, 2208, 2192, 2184, 2180, 2178, 
-2177, 2144, 2128, 2120, 2116, 2114, 2113, 2096, 2088, 2084, 
-2082, 2081, 2072, 2068, 2066, 2065, 2060, 2058, 2057, 2054, 
-2053, 2051, 1792, 1664, 1600, 1568, 1552, 1544, 1540, 1538, 
-1537, 1408, 1344, 1312, 1296, 1288, 1284, 1282, 1281, 1216, 
-1184, 1168, 1160, 1156, 1154, 1153, 1120, 1104, 1096, 1092, 
-1090, 1089, 1072, 1064, 1060, 1058, 1057, 1048, 1044, 1042, 
-1041, 1036, 1034, 1033, 1030, 1029, 1027, 896, 832, 800, 
-784, 776, 772, 770, 769, 704, 672, 656, 648, 644, 
-642, 641, 608, 592, 584, 580, 578, 577, 560, 552, 
-548, 546, 545, 536, 532, 530, 529, 524, 522, 521, 
-518, 517, 515, 448, 416, 400, 392, 388, 386, 385, 
-352, 336, 328, 324, 322, 321, 304, 296, 292, 290, 
-289, 280, 276, 274, 273, 268, 266, 265, 262, 261, 
-259, 224, 208, 200, 196, 194, 193, 176, 168, 164, 
-162, 161, 152, 148, 146, 145, 140, 138, 137, 134, 
-133, 131, 112, 104, 100, 98, 97, 88, 84, 82, 
-81, 76, 74, 73, 70, 69, 67, 56, 52, 50, 
-49, 44, 42, 41, 38, 37, 35, 28, 26, 25, 
-22, 21, 19, 14, 13, 11, 7, 7680, 7424, 7296, 
-7232, 7200, 7184, 7176, 7172, 7170, 7169, 6912, 6784, 6720, 
-6688, 6672, 6664, 6660, 6658, 6657, 6528, 6464, 6432, 6416, 
-6408, 6404, 6402, 6401, 6336, 6304, 6288, 6280, 6276, 6274, 
-6273, 6240, 6224, 6216, 6212, 6210, 6209, 6192, 6184, 6180, 
-6178, 6177, 6168, 6164, 6162, 6161, 6156, 6154, 6153, 6150, 
-6149, 6147, 5888, 5760, 5696, 5664, 5648, 5640, 5636, 5634, 
-5633, 5504, 5440, 5408, 5392, 5384, 5380, 5378, 5377, 5312, 
-5280, 5264, 5256, 5252, 5250, 5249, 5216, 5200, 5192, 5188, 
-5186, 5185, 5168, 5160, 5156, 5154, 5153, 5144, 5140, 5138, 
-5137, 5132, 5130, 5129, 5126, 5125, 5123, 4992, 4928, 4896, 
-4880, 4872, 4868, 4866, 4865, 4800, 4768, 4752, 4744, 4740, 
-4738, 4737, 4704, 4688, 4680, 4676, 4674, 4673, 4656, 4648, 
-4644, 4642, 4641, 4632, 4628, 4626, 4625, 4620, 4618, 4617, 
-4614, 4613, 4611, 4544, 4512, 4496, 4488, 4484, 4482, 4481, 
-4448, 4432, 4424, 4420, 4418, 4417, 4400, 4392, 4388, 4386, 
-4385, 4376, 4372, 4370, 4369, 4364, 4362, 4361, 4358, 4357, 
-4355, 4320, 4304, 4296, 4292, 4290, 4289, 4272, 4264, 4260, 
-4258, 4257, 4248, 4244, 4242, 4241, 4236, 4234, 4233, 4230, 
-4229, 4227, 4208, 4200, 4196, 4194, 4193, 4184, 4180, 4178, 
-4177, 4172, 4170, 4169, 4166, 4165, 4163, 4152, 4148, 4146, 
-4145, 4140, 4138, 4137, 4134, 4133, 4131, 4124, 4122, 4121, 
-4118, 4117, 4115, 4110, 4109, 4107, 4103, 3840, 3712, 3648, 
-3616, 3600, 3592, 3588, 3586, 3585, 3456, 3392, 3360, 3344, 
-3336, 3332, 3330, 3329, 3264, 3232, 3216, 3208, 3204, 3202, 
-3201, 3168, 3152, 3144, 3140, 3138, 3137, 3120, 3112, 3108, 
-3106, 3105, 3096, 3092, 3090, 3089, 3084, 3082, 3081, 3078, 
-3077, 3075, 2944, 2880, 2848, 2832, 2824, 2820, 2818, 2817, 
-2752, 2720, 2704, 2696, 2692, 2690, 2689, 2656, 2640, 2632, 
-2628, 2626, 2625, 2608, 2600, 2596, 2594, 2593, 2584, 2580, 
-2578, 2577, 2572, 2570, 2569, 2566, 2565, 2563, 2496, 2464, 
-2448, 2440, 2436, 2434, 2433, 2400, 2384, 2376, 2372, 2370, 
-2369, 2352, 2344, 2340, 2338, 2337, 2328, 2324, 2322, 2321, 
-2316, 2314, 2313, 2310, 2309, 2307, 2272, 2256, 2248, 2244, 
-2242, 2241, 2224, 2216, 2212, 2210, 2209, 2200, 2196, 2194, 
-2193, 2188, 2186, 2185, 2182, 2181, 2179, 2160, 2152, 2148, 
-2146, 2145, 2136, 2132, 2130, 2129, 2124, 2122, 2121, 2118, 
-2117, 2115, 2104, 2100, 2098, 2097, 2092, 2090, 2089, 2086, 
-2085, 2083, 2076, 2074, 2073, 2070, 2069, 2067, 2062, 2061, 
-2059, 2055, 1920, 1856, 1824, 1808, 1800, 1796, 1794, 1793, 
-1728, 1696, 1680, 1672, 1668, 1666, 1665, 1632, 1616, 1608, 
-1604, 1602, 1601, 1584, 1576, 1572, 1570, 1569, 1560, 1556, 
-1554, 1553, 1548, 1546, 1545, 1542, 1541, 1539, 1472, 1440, 
-1424, 1416, 1412, 1410, 1409, 1376, 1360, 1352, 1348, 1346, 
-1345, 1328, 1320, 1316, 1314, 1313, 1304, 1300, 1298, 1297, 
-1292, 1290, 1289, 1286, 1285, 1283, 1248, 1232, 1224, 1220, 
-1218, 1217, 1200, 1192, 1188, 1186, 1185, 1176, 1172, 1170, 
-1169, 1164, 1162, 1161, 1158, 1157, 1155, 1136, 1128, 1124, 
-1122, 1121, 1112, 1108, 1106, 1105, 1100, 1098, 1097, 1094, 
-1093, 1091, 1080, 1076, 1074, 1073, 1068, 1066, 1065, 1062, 
-1061, 1059, 1052, 1050, 1049, 1046, 1045, 1043, 1038, 1037, 
-1035, 1031, 960, 928, 912, 904, 900, 898, 897, 864, 
-848, 840, 836, 834, 833, 816, 808, 804, 802, 801, 
-792, 788, 786, 785, 780, 778, 777, 774, 773, 771, 
-736, 720, 712, 708, 706, 705, 688, 680, 676, 674, 
-673, 664, 660, 658, 657, 652, 650, 649, 646, 645, 
-643, 624, 616, 612, 610, 609, 600, 596, 594, 593, 
-588, 586, 585, 582, 581, 579, 568, 564, 562, 561, 
-556, 554, 553, 550, 549, 547, 540, 538, 537, 534, 
-533, 531, 526, 525, 523, 519, 480, 464, 456, 452, 
-450, 449, 432, 424, 420, 418, 417, 408, 404, 402, 
-401, 396, 394, 393, 390, 389, 387, 368, 360, 356, 
-354, 353, 344, 340, 338, 337, 332, 330, 329, 326, 
-325, 323, 312, 308, 306, 305, 300, 298, 297, 294, 
-293, 291, 284, 282, 281, 278, 277, 275, 270, 269, 
-267, 263, 240, 232, 228, 226, 225, 216, 212, 210, 
-209, 204, 202, 201, 198, 197, 195, 184, 180, 178, 
-177, 172, 170, 169, 166, 165, 163, 156, 154, 153, 
-150, 149, 147, 142, 141, 139, 135, 120, 116, 114, 
-113, 108, 106, 105, 102, 101, 99, 92, 90, 89, 
-86, 85, 83, 78, 77, 75, 71, 60, 58, 57, 
-54, 53, 51, 46, 45, 43, 39, 30, 29, 27, 
-23, 15
-};
-
-uint32_t filterCounts14[] = {14, 91, 364, 1001};
-uint32_t filter14[] = {8192, 4096, 2048, 1024, 512, 256, 128, 64, 32, 16, 
-8, 4, 2, 1, 12288, 10240, 9216, 8704, 8448, 8320, 
-8256, 8224, 8208, 8200, 8196, 8194, 8193, 6144, 5120, 4608, 
-4352, 4224, 4160, 4128, 4112, 4104, 4100, 4098, 4097, 3072, 
-2560, 2304, 2176, 2112, 2080, 2064, 2056, 2052, 2050, 2049, 
-1536, 1280, 1152, 1088, 1056, 1040, 1032, 1028, 1026, 1025, 
-768, 640, 576, 544, 528, 520, 516, 514, 513, 384, 
-320, 288, 272, 264, 260, 258, 257, 192, 160, 144, 
-136, 132, 130, 129, 96, 80, 72, 68, 66, 65, 
-48, 40, 36, 34, 33, 24, 20, 18, 17, 12, 
-10, 9, 6, 5, 3, 14336, 13312, 12800, 12544, 12416, 
-12352, 12320, 12304, 12296, 12292, 12290, 12289, 11264, 10752, 10496, 
-10368, 10304, 10272, 10256, 10248, 10244, 10242, 10241, 9728, 9472, 
-9344, 9280, 9248, 9232, 9224, 9220, 9218, 9217, 8960, 8832, 
-8768, 8736, 8720, 8712, 8708, 8706, 8705, 8576, 8512, 8480, 
-8464, 8456, 8452, 8450, 8449, 8384, 8352, 8336, 8328, 8324, 
-8322, 8321, 8288, 8272, 8264, 8260, 8258, 8257, 8240, 8232, 
-8228, 8226, 8225, 8216, 8212, 8210, 8209, 8204, 8202, 8201, 
-8198, 8197, 8195, 7168, 6656, 6400, 6272, 6208, 6176, 6160, 
-6152, 6148, 6146, 6145, 5632, 5376, 5248, 5184, 5152, 5136, 
-5128, 5124, 5122, 5121, 4864, 4736, 4672, 4640, 4624, 4616, 
-4612, 4610, 4609, 4480, 4416, 4384, 4368, 4360, 4356, 4354, 
-4353, 4288, 4256, 4240, 4232, 4228, 4226, 4225, 4192, 4176, 
-4168, 4164, 4162, 4161, 4144, 4136, 4132, 4130, 4129, 4120, 
-4116, 4114, 4113, 4108, 4106, 4105, 4102, 4101, 4099, 3584, 
-3328, 3200, 3136, 3104, 3088, 3080, 3076, 3074, 3073, 2816, 
-2688, 2624, 2592, 2576, 2568, 2564, 2562, 2561, 2432, 2368, 
-2336, 2320, 2312, 2308, 2306, 2305, 2240, 2208, 2192, 2184, 
-2180, 2178, 2177, 2144, 2128, 2120, 2116, 2114, 2113, 2096, 
-2088, 2084, 2082, 2081, 2072, 2068, 2066, 2065, 2060, 2058, 
-2057, 2054, 2053, 2051, 1792, 1664, 1600, 1568, 1552, 1544, 
-1540, 1538, 1537, 1408, 1344, 1312, 1296, 1288, 1284, 1282, 
-1281, 1216, 1184, 1168, 1160, 1156, 1154, 1153, 1120, 1104, 
-1096, 1092, 1090, 1089, 1072, 1064, 1060, 1058, 1057, 1048, 
-1044, 1042, 1041, 1036, 1034, 1033, 1030, 1029, 1027, 896, 
-832, 800, 784, 776, 772, 770, 769, 704, 672, 656, 
-648, 644, 642, 641, 608, 592, 584, 580, 578, 577, 
-560, 552, 548, 546, 545, 536, 532, 530, 529, 524, 
-522, 521, 518, 517, 515, 448, 416, 400, 392, 388, 
-386, 385, 352, 336, 328, 324, 322, 321, 304, 296, 
-292, 290, 289, 280, 276, 274, 273, 268, 266, 265, 
-262, 261, 259, 224, 208, 200, 196, 194, 193, 176, 
-168, 164, 162, 161, 152, 148, 146, 145, 140, 138, 
-137, 134, 133, 131, 112, 104, 100, 98, 97, 88, 
-84, 82, 81, 76, 74, 73, 70, 69, 67, 56, 
-52, 50, 49, 44, 42, 41, 38, 37, 35, 28, 
-26, 25, 22, 21, 19, 14, 13, 11, 7, 15360, 
-14848, 14592, 14464, 14400, 14368, 14352, 14344, 14340, 14338, 14337, 
-13824, 13568, 13440, 13376, 13344, 13328, 13320, 13316, 13314, 13313, 
-13056, 12928, 12864, 12832, 12816, 12808, 12804, 12802, 12801, 12672, 
-12608, 12576, 12560, 12552, 12548, 12546, 12545, 12480, 12448, 12432, 
-12424, 12420, 12418, 12417, 12384, 12368, 12360, 12356, 12354, 12353, 
-12336, 12328, 12324, 12322, 12321, 12312, 12308, 12306, 12305, 12300, 
-12298, 12297, 12294, 12293, 12291, 11776, 11520, 11392, 11328, 11296, 
-11280, 11272, 11268, 11266, 11265, 11008, 10880, 10816, 10784, 10768, 
-10760, 10756, 10754, 10753, 10624, 10560, 10528, 10512, 10504, 10500, 
-10498, 10497, 10432, 10400, 10384, 10376, 10372, 10370, 10369, 10336, 
-10320, 10312, 10308, 10306, 10305, 10288, 10280, 10276, 10274, 10273, 
-10264, 10260, 10258, 10257, 10252, 10250, 10249, 10246, 10245, 10243, 
-9984, 9856, 9792, 9760, 9744, 9736, 9732, 9730, 9729, 9600, 
-9536, 9504, 9488, 9480, 9476, 9474, 9473, 9408, 9376, 9360, 
-9352, 9348, 9346, 9345, 9312, 9296, 9288, 9284, 9282, 9281, 
-9264, 9256, 9252, 9250, 9249, 9240, 9236, 9234, 9233, 9228, 
-9226, 9225, 9222, 9221, 9219, 9088, 9024, 8992, 8976, 8968, 
-8964, 8962, 8961, 8896, 8864, 8848, 8840, 8836, 8834, 8833, 
-8800, 8784, 8776, 8772, 8770, 8769, 8752, 8744, 8740, 8738, 
-8737, 8728, 8724, 8722, 8721, 8716, 8714, 8713, 8710, 8709, 
-8707, 8640, 8608, 8592, 8584, 8580, 8578, 8577, 8544, 8528, 
-8520, 8516, 8514, 8513, 8496, 8488, 8484, 8482, 8481, 8472, 
-8468, 8466, 8465, 8460, 8458, 8457, 8454, 8453, 8451, 8416, 
-8400, 8392, 8388, 8386, 8385, 8368, 8360, 8356, 8354, 8353, 
-8344, 8340, 8338, 8337, 8332, 8330, 8329, 8326, 8325, 8323, 
-8304, 8296, 8292, 8290, 8289, 8280, 8276, 8274, 8273, 8268, 
-8266, 8265, 8262, 8261, 8259, 8248, 8244, 8242, 8241, 8236, 
-8234, 8233, 8230, 8229, 8227, 8220, 8218, 8217, 8214, 8213, 
-8211, 8206, 8205, 8203, 8199, 7680, 7424, 7296, 7232, 7200, 
-7184, 7176, 7172, 7170, 7169, 6912, 6784, 6720, 6688, 6672, 
-6664, 6660, 6658, 6657, 6528, 6464, 6432, 6416, 6408, 6404, 
-6402, 6401, 6336, 6304, 6288, 6280, 6276, 6274, 6273, 6240, 
-6224, 6216, 6212, 6210, 6209, 6192, 6184, 6180, 6178, 6177, 
-6168, 6164, 6162, 6161, 6156, 6154, 6153, 6150, 6149, 6147, 
-5888, 5760, 5696, 5664, 5648, 5640, 5636, 5634, 5633, 5504, 
-5440, 5408, 5392, 5384, 5380, 5378, 5377, 5312, 5280, 5264, 
-5256, 5252, 5250, 5249, 5216, 5200, 5192, 5188, 5186, 5185, 
-5168, 5160, 5156, 5154, 5153, 5144, 5140, 5138, 5137, 5132, 
-5130, 5129, 5126, 5125, 5123, 4992, 4928, 4896, 4880, 4872, 
-4868, 4866, 4865, 4800, 4768, 4752, 4744, 4740, 4738, 4737, 
-4704, 4688, 4680, 4676, 4674, 4673, 4656, 4648, 4644, 4642, 
-4641, 4632, 4628, 4626, 4625, 4620, 4618, 4617, 4614, 4613, 
-4611, 4544, 4512, 4496, 4488, 4484, 4482, 4481, 4448, 4432, 
-4424, 4420, 4418, 4417, 4400, 4392, 4388, 4386, 4385, 4376, 
-4372, 4370, 4369, 4364, 4362, 4361, 4358, 4357, 4355, 4320, 
-4304, 4296, 4292, 4290, 4289, 4272, 4264, 4260, 4258, 4257, 
-4248, 4244, 4242, 4241, 4236, 4234, 4233, 4230, 4229, 4227, 
-4208, 4200, 4196, 4194, 4193, 4184, 4180, 4178, 4177, 4172, 
-4170, 4169, 4166, 4165, 4163, 4152, 4148, 4146, 4145, 4140, 
-4138, 4137, 4134, 4133, 4131, 4124, 4122, 4121, 4118, 4117, 
-4115, 4110, 4109, 4107, 4103, 3840, 3712, 3648, 3616, 3600, 
-3592, 3588, 3586, 3585, 3456, 3392, 3360, 3344, 3336, 3332, 
-3330, 3329, 3264, 3232, 3216, 3208, 3204, 3202, 3201, 3168, 
-3152, 3144, 3140, 3138, 3137, 3120, 3112, 3108, 3106, 3105, 
-3096, 3092, 3090, 3089, 3084, 3082, 3081, 3078, 3077, 3075, 
-2944, 2880, 2848, 2832, 2824, 2820, 2818, 2817, 2752, 2720, 
-2704, 2696, 2692, 2690, 2689, 2656, 2640, 2632, 2628, 2626, 
-2625, 2608, 2600, 2596, 2594, 2593, 2584, 2580, 2578, 2577, 
-2572, 2570, 2569, 2566, 2565, 2563, 2496, 2464, 2448, 2440, 
-2436, 2434, 2433, 2400, 2384, 2376, 2372, 2370, 2369, 2352, 
-2344, 2340, 2338, 2337, 2328, 2324, 2322, 2321, 2316, 2314, 
-2313, 2310, 2309, 2307, 2272, 2256, 2248, 2244, 2242, 2241, 
-2224, 2216, 2212, 2210, 2209, 2200, 2196, 2194, 2193, 2188, 
-2186, 2185, 2182, 2181, 2179, 2160, 2152, 2148, 2146, 2145, 
-2136, 2132, 2130, 2129, 2124, 2122, 2121, 2118, 2117, 2115, 
-2104, 2100, 2098, 2097, 2092, 2090, 2089, 2086, 2085, 2083, 
-2076, 2074, 2073, 2070, 2069, 2067, 2062, 2061, 2059, 2055, 
-1920, 1856, 1824, 1808, 1800, 1796, 1794, 1793, 1728, 1696, 
-1680, 1672, 1668, 1666, 1665, 1632, 1616, 1608, 1604, 1602, 
-1601, 1584, 1576, 1572, 1570, 1569, 1560, 1556, 1554, 1553, 
-1548, 1546, 1545, 1542, 1541, 1539, 1472, 1440, 1424, 1416, 
-1412, 1410, 1409, 1376, 1360, 1352, 1348, 1346, 1345, 1328, 
-1320, 1316, 1314, 1313, 1304, 1300, 1298, 1297, 1292, 1290, 
-1289, 1286, 1285, 1283, 1248, 1232, 1224, 1220, 1218, 1217, 
-1200, 1192, 1188, 1186, 1185, 1176, 1172, 1170, 1169, 1164, 
-1162, 1161, 1158, 1157, 1155, 1136, 1128, 1124, 1122, 1121, 
-1112, 1108, 1106, 1105, 1100, 1098, 1097, 1094, 1093, 1091, 
-1080, 1076, 1074, 1073, 1068, 1066, 1065, 1062, 1061, 1059, 
-1052, 1050, 1049, 1046, 1045, 1043, 1038, 1037, 1035, 1031, 
-960, 928, 912, 904, 900, 898, 897, 864, 848, 840, 
-836, 834, 833, 816, 808, 804, 802, 801, 792, 788, 
-786, 785, 780, 778, 777, 774, 773, 771, 736, 720, 
-712, 708, 706, 705, 688, 680, 676, 674, 673, 664, 
-660, 658, 657, 652, 650, 649, 646, 645, 643, 624, 
-616, 612, 610, 609, 600, 596, 594, 593, 588, 586, 
-585, 582, 581, 579, 568, 564, 562, 561, 556, 554, 
-553, 550, 549, 547, 540, 538, 537, 534, 533, 531, 
-526, 525, 523, 519, 480, 464, 456, 452, 450, 449, 
-432, 424, 420, 418, 417, 408, 404, 402, 401, 396, 
-394, 393, 390, 389, 387, 368, 360, 356, 354, 353, 
-344, 340, 338, 337, 332, 330, 329, 326, 325, 323, 
-312, 308, 306, 305, 300, 298, 297, 294, 293, 291, 
-284, 282, 281, 278, 277, 275, 270, 269, 267, 263, 
-240, 232, 228, 226, 225, 216, 212, 210, 209, 204, 
-202, 201, 198, 197, 195, 184, 180, 178, 177, 172, 
-170, 169, 166, 165, 163, 156, 154, 153, 150, 149, 
-147, 142, 141, 139, 135, 120, 116, 114, 113, 108, 
-106, 105, 102, 101, 99, 92, 90, 89, 86, 85, 
-83, 78, 77, 75, 71, 60, 58, 57, 54, 53, 
-51, 46, 45, 43, 39, 30, 29, 27, 23, 15
-};
-
-#endif /* end of include guard: HAMMINGNEIGHBORHOODFILTERS_H_S0TIKDI9 */
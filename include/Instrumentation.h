@@ -0,0 +1,108 @@
+#ifndef INSTRUMENTATION_H_H3ZC6R1Q
+#define INSTRUMENTATION_H_H3ZC6R1Q
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Per-call records of what hammingHash, findComponents and simplify
+ * did: how long they took, how long each stage of hashing took, how
+ * many attempts hashing made, how many maxima, components or regions
+ * resulted, how much scratch memory was allocated and, where the
+ * kernel allows it, the instructions retired and cache misses taken by
+ * the calling thread. Records are kept in a ring buffer of the most
+ * recent calls, from which they may be drained and written out as
+ * JSON or CSV, and are also handed to a callback if one is set.
+ *
+ * Instrumentation is off until enabled. While off, each instrumented
+ * call costs a single relaxed load and branch.
+ */
+
+enum TracedFunction {
+  TRACE_HAMMING_HASH = 0,
+  TRACE_FIND_COMPONENTS = 1,
+  TRACE_SIMPLIFY = 2
+};
+
+struct CallRecord {
+  TracedFunction function;
+  // Order in which calls began, across all threads, counting from 0
+  // when instrumentation is enabled.
+  uint64_t sequence;
+  // A small number identifying the calling thread.
+  int thread;
+  // Seconds since instrumentation was enabled at which the call began,
+  // and its duration in milliseconds.
+  double start;
+  double durationMs;
+  // hammingHash only: milliseconds spent projecting, encoding, finding
+  // maxima and mapping to them, and the attempts made.
+  double projectMs, encodeMs, maximaMs, mapMs;
+  int attempts;
+  // Maxima found, components labeled, or regions left by simplify.
+  int64_t count;
+  // Bytes of scratch memory allocated by the call, counting its
+  // largest buffers (for hammingHash, what its context grew by).
+  uint64_t bytesAllocated;
+  // Hardware counters for the calling thread only (threads of an
+  // OpenMP team are not included), or -1 if unavailable.
+  int64_t instructions, cacheMisses;
+};
+
+typedef void (*InstrumentationCallback)(const CallRecord& record,
+                                        void* userData);
+
+// Start recording calls, keeping the most recent [ringCapacity]. With
+// [hardwareCounters], perf_event_open is used to count instructions
+// and cache misses where permitted.
+void enableInstrumentation(size_t ringCapacity = 4096,
+                           bool hardwareCounters = false);
+void disableInstrumentation();
+
+// Called with every record as it is made, from the thread that made
+// the call. NULL removes the callback.
+void setInstrumentationCallback(InstrumentationCallback callback,
+                                void* userData);
+
+// Move the records held by the ring buffer, oldest first, to the end
+// of [records]. Returns how many were moved.
+size_t drainInstrumentation(std::vector<CallRecord>& records);
+
+// Number of records overwritten before they could be drained.
+uint64_t instrumentationDropped();
+
+void writeRecordsJSON(FILE* out, const std::vector<CallRecord>& records);
+void writeRecordsCSV(FILE* out, const std::vector<CallRecord>& records);
+
+extern int instrumentationFlag;
+
+inline bool instrumentationEnabled() {
+  return __atomic_load_n(&instrumentationFlag, __ATOMIC_RELAXED) != 0;
+}
+
+// Records one call from construction to destruction, if
+// instrumentation was enabled when it began. The instrumented
+// function fills in the fields it knows of.
+class CallTrace {
+public:
+  explicit CallTrace(TracedFunction function)
+    : active(instrumentationEnabled()) {
+    if(active) begin(function);
+  }
+  ~CallTrace() {
+    if(active) end();
+  }
+
+  bool active;
+  CallRecord record;
+
+private:
+  void begin(TracedFunction function);
+  void end();
+  int64_t startInstructions, startCacheMisses;
+
+  CallTrace(const CallTrace&);
+  CallTrace& operator=(const CallTrace&);
+};
+
+#endif /* end of include guard: INSTRUMENTATION_H_H3ZC6R1Q */
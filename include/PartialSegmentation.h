@@ -0,0 +1,73 @@
+#ifndef PARTIALSEGMENTATION_H_6KD3TZ0P
+#define PARTIALSEGMENTATION_H_6KD3TZ0P
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
+#include "HammingHash.h"
+
+/*
+ * A PartialSegmenter segments the frames of a mostly static stream
+ * (such as a fixed camera) by redoing only the parts that changed.
+ * Each frame is compared with the last one block by block. The blocks
+ * that changed are rehashed with SegmentationSession::hashBlocks, and
+ * components are found and simplified again only within a margin
+ * around each group of changed blocks. Regions inside such a window
+ * that continue a region outside it, with the same code across the
+ * window's edge, keep that region's label; the rest get new labels.
+ *
+ * The whole frame is segmented again when too much of it has changed,
+ * when its size changes, or when the session needs a new key frame.
+ */
+class PartialSegmenter {
+public:
+  explicit PartialSegmenter(SegmentationSession& session);
+
+  // Segment [imgIn], the image that is hashed (e.g. HSV), into region
+  // labels in [labels] (CV_32S), with edge support taken from
+  // [imgColor] as by simplify. Returns one more than the largest
+  // label. Labels are not compact: labels of regions that disappear
+  // are not reused until the next full segmentation.
+  int segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+              cv::Mat& labels);
+
+  // Side in pixels of the square blocks frames are compared in.
+  // Defaults to 32.
+  int blockSize;
+
+  // A block has changed when the mean absolute difference of its
+  // channels from the last frame exceeds this. Defaults to 4.
+  float changeThreshold;
+
+  // The largest fraction of blocks that may change before the whole
+  // frame is segmented again. Defaults to 0.5.
+  float maxDirtyFraction;
+
+  // Pixels around each group of changed blocks that are segmented
+  // again along with it, so that regions the change split or joined
+  // are seen whole. Defaults to 8.
+  int border;
+
+  // Number of changed blocks in the last frame, and whether it was
+  // segmented in full.
+  int lastDirtyBlocks;
+  bool lastFrameFull;
+
+private:
+  SegmentationSession& session;
+
+  // The pixels last hashed, the coded image they produced, and the
+  // labels given to it.
+  cv::Mat prevFrame;
+  cv::Mat codes;
+  cv::Mat labelImg;
+  uint32_t nextLabel;
+
+  int segmentFull(const cv::Mat& imgIn, const cv::Mat& imgColor,
+                  cv::Mat& labels);
+  void resegmentWindow(const cv::Mat& imgColor, const cv::Rect& window);
+
+  PartialSegmenter(const PartialSegmenter&);
+  PartialSegmenter& operator=(const PartialSegmenter&);
+};
+
+#endif /* end of include guard: PARTIALSEGMENTATION_H_6KD3TZ0P */
@@ -0,0 +1,123 @@
+#ifndef PROJECTIONKERNELS_H_7XKD2M4P
+#define PROJECTIONKERNELS_H_7XKD2M4P
+#include <vector>
+#include <stdint.h>
+
+// Row kernels used by hammingHash to project pixels onto splitting
+// planes and to turn projections into Hamming codes. Each kernel is
+// available in a scalar form and, on x86, in SSE and AVX2 forms; the
+// vector forms work on up to 8 planes per instruction and build code
+// bits with a compare followed by a movemask. All forms perform the
+// same floating point operations in the same order, so they produce
+// identical projections and codes.
+
+enum ProjectionISA {
+  ISA_SCALAR = 0,
+  ISA_SSE = 1,
+  ISA_AVX2 = 2
+};
+
+// The best instruction set supported by the running CPU.
+ProjectionISA detectProjectionISA();
+
+// Splitting planes rearranged for the row kernels. Weights are stored
+// channel-major, with the plane index padded to a multiple of 8 so
+// that vector kernels may load whole registers.
+struct PlaneLayout {
+  int numPlanes;
+  int numChannels;
+  int paddedPlanes;
+
+  // weights[d*paddedPlanes + plane] is channel [d] of plane [plane].
+  std::vector<float> weights;
+
+  // Per-plane threshold used to decide each code bit.
+  std::vector<float> midpoints;
+
+  // Rebuild the layout from planes stored plane-major, as they are
+  // passed to hammingHash.
+  void setPlanes(const std::vector<float>& planes, int numChannels);
+
+  // Set each plane's threshold to the midpoint of its extrema.
+  void setMidpoints(const float* minimums, const float* maximums);
+};
+
+// Project [cols] pixels of [numChannels] bytes each onto every
+// plane. Projections are written pixel-major to [projections] unless
+// it is NULL. [minRow] and [maxRow], which must hold
+// layout.paddedPlanes entries, are updated with the extrema of each
+// plane's projections.
+typedef void (*ProjectRowFn)(const PlaneLayout& layout,
+                             const uint8_t* pixels, int cols,
+                             float* projections,
+                             float* minRow, float* maxRow);
+
+// Compute the Hamming code of each of [cols] pixel-major projections.
+typedef void (*EncodeRowFn)(const PlaneLayout& layout,
+                            const float* projections, int cols,
+                            uint32_t* codes);
+
+// Project and encode [cols] pixels without storing projections.
+typedef void (*ProjectEncodeRowFn)(const PlaneLayout& layout,
+                                   const uint8_t* pixels, int cols,
+                                   uint32_t* codes);
+
+struct ProjectionKernels {
+  ProjectRowFn projectRow;
+  EncodeRowFn encodeRow;
+  ProjectEncodeRowFn projectEncodeRow;
+};
+
+// Kernels for the given instruction set. Requesting an instruction
+// set the CPU does not support yields the best one it does.
+const ProjectionKernels& projectionKernels(ProjectionISA isa);
+
+// Quantized contribution of every byte value of every channel to
+// every plane's projection. For 8-bit inputs a pixel's projection is
+// then the sum of one table entry per channel, computed with integer
+// adds and no multiplies. The quantization scale is chosen so that
+// any such sum fits in an int16_t.
+struct ProjectionTable {
+  int numPlanes;
+  int numChannels;
+  int paddedPlanes;
+  float scale;
+
+  // entries[(d*256 + v)*paddedPlanes + plane] is the contribution of
+  // value [v] in channel [d] to the projection onto [plane].
+  std::vector<int16_t> entries;
+
+  // Per-plane threshold used to decide each code bit.
+  std::vector<int16_t> midpoints;
+
+  ProjectionTable() : numPlanes(0), numChannels(0), paddedPlanes(0),
+                      scale(0.0f) {}
+
+  // Bring the table up to date with [planes] (stored plane-major),
+  // recomputing only the planes whose coefficients changed since the
+  // last update. Returns the number of planes that were rebuilt.
+  int update(const std::vector<float>& planes, int numChannels);
+
+  // Set each plane's threshold to the midpoint of its extrema.
+  void setMidpoints(const int16_t* minimums, const int16_t* maximums);
+
+private:
+  // The planes the table was built from.
+  std::vector<float> sourcePlanes;
+  void buildPlane(int plane);
+};
+
+// Table-driven counterparts of the ProjectRowFn, EncodeRowFn and
+// ProjectEncodeRowFn kernels.
+void projectRowLUT(const ProjectionTable& table,
+                   const uint8_t* pixels, int cols,
+                   int16_t* projections,
+                   int16_t* minRow, int16_t* maxRow);
+void encodeRowLUT(const ProjectionTable& table,
+                  const int16_t* projections, int cols,
+                  uint32_t* codes);
+void projectEncodeRowLUT(const ProjectionTable& table,
+                         const uint8_t* pixels, int cols,
+                         uint32_t* codes);
+
+#endif /* end of include guard: PROJECTIONKERNELS_H_7XKD2M4P */
@@ -0,0 +1,70 @@
+#ifndef RANDOMGENERATOR_H_M7PX2D4K
+#define RANDOMGENERATOR_H_M7PX2D4K
+#include <stdint.h>
+
+/*
+ * A small, fast pseudorandom number generator (xoshiro128**) whose
+ * state is owned by its user, so that generators used on different
+ * threads never contend (as callers of the C library's rand() do on
+ * its lock) and a given seed always yields the same sequence.
+ *
+ * A seed may be paired with a stream number to give several
+ * independent sequences from one seed, such as one per image of a
+ * batch, which then do not depend on which thread handles which image.
+ */
+class RandomGenerator {
+public:
+  // The seed used when none is given.
+  static const uint64_t DEFAULT_SEED = 0x5DEECE66DULL;
+
+  explicit RandomGenerator(uint64_t seed = DEFAULT_SEED,
+                           uint64_t stream = 0) {
+    this->seed(seed, stream);
+  }
+
+  // Restart the sequence of [stream] of [seed].
+  void seed(uint64_t seed, uint64_t stream = 0) {
+    // Expand the seed and stream into the state with splitmix64, whose
+    // outputs are never both zero for consecutive inputs.
+    uint64_t x = seed ^ mix(stream + 0x632BE59BD9B4E019ULL);
+    for(int i = 0; i < 4; i += 2) {
+      x += 0x9E3779B97F4A7C15ULL;
+      uint64_t z = mix(x);
+      s[i] = (uint32_t)z;
+      s[i+1] = (uint32_t)(z >> 32);
+    }
+  }
+
+  // The next 32 uniformly distributed bits.
+  inline uint32_t next() {
+    uint32_t result = rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+    return result;
+  }
+
+  // Uniformly distributed in [-1, 1).
+  inline float uniformSigned() {
+    return (next() >> 8) * (1.0f / (1 << 23)) - 1.0f;
+  }
+
+private:
+  uint32_t s[4];
+
+  static inline uint32_t rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+  }
+
+  static inline uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+};
+
+#endif /* end of include guard: RANDOMGENERATOR_H_M7PX2D4K */
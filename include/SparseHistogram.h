@@ -0,0 +1,111 @@
+#ifndef SPARSEHISTOGRAM_H_C4TW9JHE
+#define SPARSEHISTOGRAM_H_C4TW9JHE
+#include <vector>
+#include <stdint.h>
+
+/*
+ * A SparseHistogram counts 64-bit Hamming codes without allocating a
+ * bin for every possible code. Only occupied codes are stored, as
+ * parallel arrays of entries, and an open-addressing hash table maps
+ * each code to its entry. This is what lets hammingHash use more
+ * planes than a dense table of 1 << numPlanes bins can hold: the
+ * memory used grows with the number of distinct codes (at most the
+ * number of pixels) rather than with the size of the code space.
+ *
+ * Colors are summed as integers, as they are by the dense histogram,
+ * so that merging per-thread histograms gives the same totals in any
+ * order.
+ */
+class SparseHistogram {
+public:
+  SparseHistogram();
+
+  // Remove every entry. The hash table keeps its size.
+  void clear();
+
+  // Count one pixel of [numChannels] bytes (at most 3 of which are
+  // summed) under [code].
+  inline void add(uint64_t code, const uint8_t* color, int numChannels) {
+    uint32_t entry = insert(code);
+    counts[entry]++;
+    uint64_t* sum = &colorSums[entry*3];
+    for(int d = 0; d < numChannels && d < 3; d++) sum[d] += color[d];
+  }
+
+  // Add every entry of [other] to this histogram.
+  void merge(const SparseHistogram& other);
+
+  // Reorder the entries by ascending code.
+  void sortByCode();
+
+  // The entry holding [code], or NOT_FOUND.
+  inline uint32_t find(uint64_t code) const {
+    for(uint64_t slot = hashSlot(code); ; slot = (slot + 1) & slotMask) {
+      uint32_t entry = slots[slot];
+      if(entry == NOT_FOUND || codes[entry] == code) return entry;
+    }
+  }
+
+  static const uint32_t NOT_FOUND = 0xffffffff;
+
+  uint32_t size() const { return codes.size(); }
+
+  // One element per entry (three for [colorSums]).
+  std::vector<uint64_t> codes;
+  std::vector<uint32_t> counts;
+  std::vector<uint64_t> colorSums;
+
+private:
+  // Hash table of entry indices, a power of two in size and never
+  // more than half full.
+  std::vector<uint32_t> slots;
+  uint64_t slotMask;
+  int slotShift;
+
+  inline uint64_t hashSlot(uint64_t code) const {
+    return (code * 0x9e3779b97f4a7c15ULL) >> slotShift;
+  }
+
+  // The entry holding [code], which is created if there is none.
+  inline uint32_t insert(uint64_t code) {
+    uint64_t slot = hashSlot(code);
+    for(; ; slot = (slot + 1) & slotMask) {
+      uint32_t entry = slots[slot];
+      if(entry == NOT_FOUND) break;
+      if(codes[entry] == code) return entry;
+    }
+    uint32_t entry = codes.size();
+    codes.push_back(code);
+    counts.push_back(0);
+    colorSums.resize(colorSums.size() + 3, 0);
+    slots[slot] = entry;
+    if(2*codes.size() > slots.size()) rehash(2*slots.size());
+    return entry;
+  }
+
+  // Resize the hash table to [numSlots] and reinsert every entry.
+  void rehash(size_t numSlots);
+};
+
+// Find the codes of [histogram] that are more popular than every
+// other occupied code within Hamming distance [hammingK]. Maxima are
+// appended to [hMaxima] in the order of the histogram's entries, which
+// is ascending once sortByCode has been called. Neighbors are found
+// either by flipping bits of a code and looking the result up, or by
+// comparing the code against every entry at least as popular,
+// whichever visits fewer codes; the code space itself is never
+// enumerated.
+void sparseHammingMaxima(const SparseHistogram& histogram,
+                         int numPlanes, int hammingK,
+                         std::vector<uint64_t>& hMaxima);
+
+// Map each entry of [histogram] to the index in [hMaxima] (which must
+// be in ascending order) of its nearest maximum, breaking ties as the
+// dense mapToMaxima does. [mapping] is resized to one element per
+// entry. The counts of the maxima's entries accumulate the counts of
+// the entries mapped to them.
+void sparseMapToMaxima(SparseHistogram& histogram,
+                       const std::vector<uint64_t>& hMaxima,
+                       std::vector<uint32_t>& mapping);
+
+#endif /* end of include guard: SPARSEHISTOGRAM_H_C4TW9JHE */
@@ -0,0 +1,136 @@
+#ifndef TILEDSEGMENTATION_H_5RB8XN2C
+#define TILEDSEGMENTATION_H_5RB8XN2C
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
+#include "HammingHash.h"
+
+/*
+ * A TiledSegmenter segments images too large to hold in memory, such
+ * as aerial or slide-scanner imagery, reading them from binary (P6)
+ * PPM files through a memory map and writing labels through another.
+ *
+ * The image is visited in square tiles. A first streaming pass finds
+ * the extrema of every plane's projections over the whole image, and
+ * a second encodes each tile against the resulting midpoints and adds
+ * it to one global code histogram. Maxima, plane retries and the
+ * mapping of codes to maxima then proceed as in hammingHash. A final
+ * pass encodes, maps and labels each tile on its own, and joins
+ * components that continue across tile seams with a union-find. After
+ * each row of tiles, the regions that no longer reach its lower edge
+ * are numbered and the union-find is cut down to the regions still
+ * open; those are numbered once they close, and a last pass rewrites
+ * the rows they were open in. Since extrema and
+ * histogram are global, the regions found are exactly those that
+ * hammingHash and findComponents would find in the whole image with
+ * the same planes and random stream (without simplification, which
+ * needs the whole image).
+ *
+ * Memory is bounded by the tile size, plus one row of codes and labels
+ * across the image's width, the code histogram, 4 bytes per component
+ * of the row of tiles being labeled, and 4 bytes per region left open
+ * along each seam between rows of tiles (at most the image's width);
+ * mapped pages are released as each row of tiles is finished. Only
+ * dense histograms (up to ctx.maxDensePlanes planes) and floating
+ * point projections are supported, and an image may have at most
+ * 2^31 regions.
+ */
+class TiledSegmenter {
+public:
+  TiledSegmenter(const std::vector<float>& planes,
+                 uint32_t hammingK,
+                 int maxRetries = 5);
+
+  // Segment the 8-bit binary PPM image at [inputPath], writing the
+  // label of each pixel to [outputPath] as a 32-bit integer in native
+  // byte order, row by row. Labels are numbered from 0 as regions are
+  // finished, after the last row of tiles they reach; regions finished
+  // in the same row of tiles are numbered in the order in which they
+  // first appear, visiting tiles in raster order and the pixels of
+  // each tile in raster order. Returns the number of regions, 0 if no
+  // Hamming maxima were found (or the planes need a sparse
+  // histogram), or -1 if either file could not be used.
+  int segment(const char* inputPath, const char* outputPath);
+
+  // Side in pixels of the square tiles the image is visited in.
+  // Defaults to 1024.
+  int tileSize;
+
+  // If set, applied to the pixels of each tile (RGB, as stored in the
+  // PPM) to produce the channels that are hashed, e.g. a conversion
+  // to HSV. Must work pixel by pixel, so that tiles convert as the
+  // whole image would.
+  void (*convert)(const cv::Mat& tileIn, cv::Mat& tileOut);
+
+  // Scratch space, instruction set and random stream for hashing.
+  // Streams projections; integerProjections is ignored.
+  SegmentationContext ctx;
+
+  // The planes hashed against. Updated by the retries, as by
+  // hammingHash.
+  std::vector<float> planes;
+  uint32_t hammingK;
+  int maxRetries;
+
+  // The last image's size, its Hamming maxima, the attempts made to
+  // find them, the components found within tiles, and the regions
+  // left once they were joined across seams.
+  int lastWidth, lastHeight;
+  int lastMaxima;
+  int lastAttempts;
+  size_t lastTileComponents;
+  size_t lastRegions;
+
+private:
+  // The mapped input image, and the mapped output labels.
+  const uint8_t* pixels;
+  size_t pixelsOffset, pixelsLength;
+  uint32_t* labels;
+  size_t labelsLength;
+  int width, height;
+
+  // The pixels of the tile being worked on, converted, and their codes.
+  cv::Mat tileColor, tileCodes;
+
+  // Color sums of the codes in the histogram, 3 per code.
+  std::vector<uint64_t> colorSums;
+
+  // Union-find over the labels of the row of tiles being labeled: the
+  // regions left open by the rows above, followed by the labels given
+  // within each tile, offset by the labels of the tiles before it.
+  std::vector<uint32_t> parent;
+
+  // What each label of the last row of tiles finished became.
+  std::vector<uint32_t> rowFates;
+
+  // For each row of tiles finished, what each region left open along
+  // its lower edge became in the next: a final number, or a region
+  // still open there (marked by the top bit).
+  std::vector<std::vector<uint32_t> > openFates;
+
+  // Regions numbered so far.
+  uint32_t numRegions;
+
+  // Codes and labels along the right edge of the last tile and along
+  // the bottom edge of the last row of tiles.
+  std::vector<uint32_t> leftCodes, leftLabels;
+  std::vector<uint32_t> aboveCodes, aboveLabels;
+
+  int segmentMapped();
+  cv::Rect tileAt(int index) const;
+  int numTiles() const;
+  void loadTile(const cv::Rect& tile);
+  void encodeTile(const cv::Rect& tile);
+  void releaseRows(int y0, int y1);
+  void histogramPass(int numPlanes);
+  void labelTile(const cv::Rect& tile, const uint32_t* binMapping);
+  uint32_t findRoot(uint32_t label);
+  void join(uint32_t a, uint32_t b);
+  void finishRow(int y0, int y1);
+  void resolveOpenRegions();
+
+  TiledSegmenter(const TiledSegmenter&);
+  TiledSegmenter& operator=(const TiledSegmenter&);
+};
+
+#endif /* end of include guard: TILEDSEGMENTATION_H_5RB8XN2C */
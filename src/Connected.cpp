@@ -1,164 +1,280 @@
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include "Connected.h"
+#include "Instrumentation.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
-// Distinguish connected components from other regions with the same
-// code.
-int findComponents(cv::Mat& imgIn) {
-  uint32_t prevRow[imgIn.cols];
-  uint32_t componentCount = 1;
-  uint32_t prevCol;
-  uint32_t curr;
-  uint32_t prevComponent;
-  uint32_t prevRowComponents[imgIn.cols];
-  uint32_t *row = (uint32_t*)imgIn.ptr(0);
-  vector<uint32_t> renamer;
-
-  memcpy(prevRow, row, sizeof(uint32_t)*imgIn.cols);
-
-  renamer.reserve(1024);
-
-  // We start naming components at 1, so fill in the first entries in
-  // the population tracker and renamer. Note that a zero in the
-  // renamer represents the nop that terminates a renaming chain.
-  renamer.push_back(0);
-
-  // Handle first pixel
-  prevRowComponents[0] = 1;
-  prevComponent = 1;
-  prevCol = *row;
-  *row = 1;
-  renamer.push_back(0);
-  componentCount = 2;
-  row++;
-
-  // Handle the rest of the first row
-  for(int x = 1; x < imgIn.cols; x++, row++) {
-    curr = *row;
-    if(curr != prevCol) {
-      *row = componentCount;
-      prevComponent = componentCount++;
-      renamer.push_back(0);
-      prevCol = curr;
-    }
-    else {
-      *row = prevComponent;
-    }
-    prevRowComponents[x] = prevComponent;
+// Components are labeled in horizontal bands, one per thread, each
+// with labels of its own. Every union links the larger root to the
+// smaller, so the root of each component is always the label given
+// to its first pixel in raster order.
+
+// Fewer rows than this per band and the border merges outweigh the
+// savings.
+static const int MIN_BAND_ROWS = 32;
+
+// The rows of an image labeled by one thread, and what is needed to
+// join its components to those of the bands around it.
+struct Band {
+  int top, bottom;
+
+  // parent[l] is the label that local label [l] was merged into, or
+  // [l] itself for roots. Once the band is labeled, every entry points
+  // straight at its root.
+  vector<uint32_t> parent;
+
+  // The codes of the band's first and last rows, which labeling
+  // overwrites.
+  vector<uint32_t> firstCodes, lastCodes;
+
+  // The first global label of the band, and the first compact
+  // identifier given to its roots.
+  uint32_t labelOffset;
+  uint32_t firstId;
+};
+
+// Root of [label], halving the path to it along the way.
+static inline uint32_t findRoot(uint32_t* parent, uint32_t label) {
+  while(parent[label] != label) {
+    parent[label] = parent[parent[label]];
+    label = parent[label];
   }
+  return label;
+}
 
-  // Handle the rest of the rows
-  for(int y = 1; y < imgIn.rows; y++) {
-
-    // Handle the first column
-    curr = *row;
-    if(prevRow[0] == curr) {
-      uint32_t oldName = prevRowComponents[0];
-      prevComponent = oldName;
-      if(renamer[prevComponent]) {
-        while(renamer[prevComponent]) prevComponent = renamer[prevComponent];
-        while(renamer[oldName]) {
-          uint32_t temp = renamer[oldName];
-          renamer[oldName] = prevComponent;
-          oldName = temp;
-        }
-      }
+static inline uint32_t unite(uint32_t* parent, uint32_t a, uint32_t b) {
+  a = findRoot(parent, a);
+  b = findRoot(parent, b);
+  if(a < b) parent[b] = a;
+  else if(b < a) parent[a] = b;
+  return a < b ? a : b;
+}
 
-      *row = prevComponent;
-    }
-    else {
-      *row = componentCount;
-      prevRow[0] = curr;
-      prevComponent = componentCount;
-      renamer.push_back(0);
-      componentCount++;
+// Roots precede the labels merged into them, so one ascending pass
+// points every label of [band] at its root.
+static void flattenBand(Band& band) {
+  vector<uint32_t>& parent = band.parent;
+  for(uint32_t l = 0; l < parent.size(); l++)
+    parent[l] = parent[parent[l]];
+}
+
+// Label the rows of [band] with a sequential raster scan: a pixel
+// continues the component to its left or above whenever it has the
+// same code, and starts a new one otherwise.
+static void labelBand(cv::Mat& img, Band& band) {
+  int cols = img.cols;
+  vector<uint32_t>& parent = band.parent;
+  vector<uint32_t> aboveCodes(cols), rowCodes(cols);
+  parent.clear();
+
+  for(int y = band.top; y < band.bottom; y++) {
+    uint32_t* row = (uint32_t*)img.ptr(y);
+    const uint32_t* above = y > band.top ? (uint32_t*)img.ptr(y - 1) : NULL;
+    uint32_t prevCode = 0, label = 0;
+    for(int x = 0; x < cols; x++) {
+      uint32_t code = row[x];
+      bool left = x > 0 && code == prevCode;
+      bool up = above && code == aboveCodes[x];
+      if(left && up) {
+        if(label != above[x]) label = unite(&parent[0], label, above[x]);
+      }
+      else if(up) {
+        label = above[x];
+      }
+      else if(!left) {
+        label = parent.size();
+        parent.push_back(label);
+      }
+      rowCodes[x] = code;
+      row[x] = label;
+      prevCode = code;
     }
-    prevRowComponents[0] = prevComponent;
-    prevCol = curr;
-    row++;
-    
-    // Handle the rest of the columns
-    for(int x = 1; x < imgIn.cols; x++, row++) {
-      curr = *row;
-      if(prevCol == curr) {
-        // Continue component from the left
-        if(prevRow[x] == curr) {
-          // Continue from above, too
-          uint32_t oldName = prevRowComponents[x];
-          uint32_t above = oldName;
-          while(renamer[above]) above = renamer[above];
-          while(renamer[oldName]) {
-            uint32_t temp = renamer[oldName];
-            renamer[oldName] = above;
-            oldName = temp;
-          }
-
-          if(above != prevComponent) {
-            // Merge components
-            renamer[prevComponent] = above;
-            prevComponent = above;
-          }
-        }
-        else {
-          // Not connected above
-          prevRow[x] = curr;
-          prevRowComponents[x] = prevComponent;
-        }
+    if(y == band.top) band.firstCodes = rowCodes;
+    aboveCodes.swap(rowCodes);
+  }
+  band.lastCodes.swap(aboveCodes);
+  flattenBand(band);
+}
+
+// A horizontal run of pixels sharing a code.
+struct Run {
+  int start, end;
+  uint32_t code;
+  uint32_t label;
+};
+
+// Label the rows of [band] a run at a time: a run continues the
+// component of every run of the same code that it overlaps in the row
+// above, and starts a new one if there is none. Runs are found and
+// filled in place, so no per-pixel decisions are made.
+static void labelBandRuns(cv::Mat& img, Band& band) {
+  int cols = img.cols;
+  vector<uint32_t>& parent = band.parent;
+  vector<Run> above, runs;
+  parent.clear();
+
+  for(int y = band.top; y < band.bottom; y++) {
+    uint32_t* row = (uint32_t*)img.ptr(y);
+    if(y == band.top) band.firstCodes.assign(row, row + cols);
+    if(y == band.bottom - 1) band.lastCodes.assign(row, row + cols);
+
+    runs.clear();
+    size_t first = 0;
+    for(int x = 0; x < cols; ) {
+      Run run;
+      run.start = x;
+      run.code = row[x];
+      for(x++; x < cols && row[x] == run.code; x++);
+      run.end = x;
+
+      // Skip the runs above that end before this one starts; the
+      // rest, up to the first that starts after it ends, overlap it.
+      while(first < above.size() && above[first].end <= run.start) first++;
+      bool joined = false;
+      for(size_t j = first; j < above.size() && above[j].start < run.end; j++) {
+        if(above[j].code != run.code) continue;
+        if(!joined) run.label = above[j].label;
+        else if(run.label != above[j].label)
+          run.label = unite(&parent[0], run.label, above[j].label);
+        joined = true;
       }
-      else {
-        // Not connected on the left
-        prevCol = curr;
-        if(prevRow[x] == curr) {
-          // Continue component from above
-          uint32_t oldName = prevRowComponents[x];
-          prevComponent = oldName;
-          while(renamer[prevComponent]) 
-            prevComponent = renamer[prevComponent];
-          while(renamer[oldName]) {
-            uint32_t temp = renamer[oldName];
-            renamer[oldName] = prevComponent;
-            oldName = temp;
-          }
-
-          prevRowComponents[x] = prevComponent;
-        }
-        else {
-          // New component
-          prevComponent = componentCount++;
-          prevRow[x] = curr;
-          prevRowComponents[x] = prevComponent;
-          renamer.push_back(0);
-        }
+      if(!joined) {
+        run.label = parent.size();
+        parent.push_back(run.label);
       }
-      *row = prevComponent;
+
+      fill(row + run.start, row + run.end, run.label);
+      runs.push_back(run);
     }
+    above.swap(runs);
+  }
+  flattenBand(band);
+}
+
+static inline uint32_t findRootShared(uint32_t* parent, uint32_t label) {
+  uint32_t next;
+  while((next = __atomic_load_n(&parent[label], __ATOMIC_RELAXED)) != label)
+    label = next;
+  return label;
+}
+
+// Merge the components holding global labels [a] and [b] while other
+// threads may be doing the same. Links only ever point at smaller
+// labels, so a root that lost a race is found again and retried.
+static inline void uniteShared(uint32_t* parent, uint32_t a, uint32_t b) {
+  while(1) {
+    a = findRootShared(parent, a);
+    b = findRootShared(parent, b);
+    if(a == b) return;
+    if(a < b) swap(a, b);
+    if(__sync_bool_compare_and_swap(&parent[a], a, b)) return;
+  }
+}
+
+int findComponents(cv::Mat& imgIn, LabelingMode mode) {
+  CallTrace trace(TRACE_FIND_COMPONENTS);
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  int numBands = min(maxThreads, max(1, imgIn.rows / MIN_BAND_ROWS));
+  vector<Band> bands(numBands);
+  for(int b = 0; b < numBands; b++) {
+    bands[b].top = (int)((int64_t)imgIn.rows * b / numBands);
+    bands[b].bottom = (int)((int64_t)imgIn.rows * (b + 1) / numBands);
   }
 
-  // Compress the range of component identifiers
-  vector<uint32_t> shrinker(componentCount, 0);
-  uint32_t keeperCount = 1;
-  for(int i = 0; i < componentCount; i++) {
-    uint32_t finalCode = i;
-    while(renamer[finalCode]) finalCode = renamer[finalCode];
-    uint32_t oldName = i;
-    while(renamer[oldName]) {
-      uint32_t temp = renamer[oldName];
-      renamer[oldName] = finalCode;
-      oldName = temp;
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands; b++) {
+    if(mode == LABEL_RUNS) labelBandRuns(imgIn, bands[b]);
+    else labelBand(imgIn, bands[b]);
+  }
+
+  // Gather every band's labels into one forest.
+  uint32_t numLabels = 0;
+  for(int b = 0; b < numBands; b++) {
+    bands[b].labelOffset = numLabels;
+    numLabels += bands[b].parent.size();
+  }
+  vector<uint32_t> parent(numLabels);
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands; b++) {
+    const Band& band = bands[b];
+    for(uint32_t l = 0; l < band.parent.size(); l++)
+      parent[band.labelOffset + l] = band.labelOffset + band.parent[l];
+  }
+
+  // Join components across the border below each band.
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands - 1; b++) {
+    const Band& upper = bands[b];
+    const Band& lower = bands[b + 1];
+    const uint32_t* above = (uint32_t*)imgIn.ptr(upper.bottom - 1);
+    const uint32_t* below = (uint32_t*)imgIn.ptr(lower.top);
+    uint32_t lastA = 0xffffffff, lastB = 0xffffffff;
+    for(int x = 0; x < imgIn.cols; x++) {
+      if(upper.lastCodes[x] != lower.firstCodes[x]) continue;
+      uint32_t a = upper.labelOffset + above[x];
+      uint32_t b = lower.labelOffset + below[x];
+      if(a == lastA && b == lastB) continue;
+      uniteShared(&parent[0], a, b);
+      lastA = a;
+      lastB = b;
     }
+  }
 
-    uint32_t col = shrinker[finalCode];
-    if(col) shrinker[i] = col;
-    else {
-      shrinker[finalCode] = keeperCount;
-      shrinker[i] = keeperCount;
-      keeperCount++;
+  // Point every label at its root, and number the roots in ascending
+  // order. Each band numbers its own labels, having first counted its
+  // roots to find where its numbering starts.
+  vector<uint32_t> ids(numLabels);
+  vector<uint32_t> rootCounts(numBands, 0);
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands; b++) {
+    uint32_t first = bands[b].labelOffset;
+    uint32_t last = first + bands[b].parent.size();
+    for(uint32_t l = first; l < last; l++) {
+      uint32_t root = findRootShared(&parent[0], l);
+      __atomic_store_n(&parent[l], root, __ATOMIC_RELAXED);
+      if(root == l) rootCounts[b]++;
     }
   }
+  uint32_t componentCount = 2;
+  for(int b = 0; b < numBands; b++) {
+    bands[b].firstId = componentCount;
+    componentCount += rootCounts[b];
+  }
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands; b++) {
+    uint32_t first = bands[b].labelOffset;
+    uint32_t last = first + bands[b].parent.size();
+    uint32_t id = bands[b].firstId;
+    for(uint32_t l = first; l < last; l++)
+      if(parent[l] == l) ids[l] = id++;
+  }
 
-  row = (uint32_t*)imgIn.ptr(0);
-  for(int i = 0; i < imgIn.rows * imgIn.cols; i++, row++)
-    *row = shrinker[*row];
+  // Relabel every pixel with its component's identifier.
+  #pragma omp parallel for schedule(static, 1)
+  for(int b = 0; b < numBands; b++) {
+    const Band& band = bands[b];
+    for(int y = band.top; y < band.bottom; y++) {
+      uint32_t* row = (uint32_t*)imgIn.ptr(y);
+      for(int x = 0; x < imgIn.cols; x++)
+        row[x] = ids[parent[band.labelOffset + row[x]]];
+    }
+  }
 
-  return keeperCount;
+  if(trace.active) {
+    trace.record.count = componentCount - 2;
+    uint64_t bytes = (uint64_t)numLabels * 2 * sizeof(uint32_t);
+    for(int b = 0; b < numBands; b++)
+      bytes += (bands[b].parent.capacity() + bands[b].firstCodes.capacity() +
+                bands[b].lastCodes.capacity()) * sizeof(uint32_t);
+    trace.record.bytesAllocated = bytes;
+  }
+  return componentCount;
 }
@@ -0,0 +1,202 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <sys/time.h>
+#include "DeadlineSegmenter.h"
+#include "Connected.h"
+
+using namespace std;
+
+int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes);
+
+// Weight given to each new timing when fitting stage costs.
+static const float COST_SMOOTHING = 0.25f;
+
+static inline float elapsedMs(const struct timeval& start,
+                              const struct timeval& stop) {
+  return (stop.tv_sec - start.tv_sec) * 1000.0f +
+         0.001f * (stop.tv_usec - start.tv_usec);
+}
+
+// Append [q] to [levels] unless it is the same as the last level.
+static void addLevel(vector<QualityLevel>& levels, const QualityLevel& q) {
+  if(!levels.empty()) {
+    const QualityLevel& last = levels.back();
+    if(last.scale == q.scale && last.numPlanes == q.numPlanes &&
+       last.hammingK == q.hammingK && last.maxRetries == q.maxRetries &&
+       last.simplify == q.simplify)
+      return;
+  }
+  levels.push_back(q);
+}
+
+DeadlineSegmenter::DeadlineSegmenter(float deadlineMs,
+                                     const QualityLevel& best,
+                                     int numChannels,
+                                     uint64_t seed)
+  : deadlineMs(deadlineMs), headroom(0.85f), upgradeFrames(15),
+    session(best.numPlanes, numChannels, best.hammingK, best.maxRetries,
+            seed),
+    level(0), framesFitting(0),
+    resizeCost(-1.0f), hashCost(-1.0f), labelCost(-1.0f),
+    simplifyCost(-1.0f), numChannels(numChannels) {
+  QualityLevel q = best;
+  addLevel(levels, q);
+  q.maxRetries = 1;
+  addLevel(levels, q);
+  q.scale = best.scale * 0.75f;
+  addLevel(levels, q);
+  q.scale = best.scale * 0.5f;
+  addLevel(levels, q);
+  q.hammingK = max(1, best.hammingK - 1);
+  addLevel(levels, q);
+  q.numPlanes = max(4, best.numPlanes - 2);
+  addLevel(levels, q);
+  q.simplify = false;
+  addLevel(levels, q);
+  q.scale = best.scale * 0.25f;
+  addLevel(levels, q);
+
+  memset(&lastFrame, 0, sizeof(lastFrame));
+}
+
+float DeadlineSegmenter::predict(const QualityLevel& q,
+                                 size_t numPixels) const {
+  // Stages not measured yet are assumed free, so that they get tried.
+  float pixels = numPixels * q.scale * q.scale;
+  float ms = 0.0f;
+  if(q.scale < 1.0f && resizeCost > 0.0f) ms += resizeCost * numPixels;
+  if(hashCost > 0.0f) ms += hashCost * pixels * q.numPlanes * q.maxRetries;
+  if(labelCost > 0.0f) ms += labelCost * pixels;
+  if(q.simplify && simplifyCost > 0.0f) ms += simplifyCost * pixels;
+  return ms;
+}
+
+void DeadlineSegmenter::chooseLevel(size_t numPixels) {
+  float budget = headroom * deadlineMs;
+  int fitting = levels.size() - 1;
+  for(int i = 0; i < (int)levels.size(); i++) {
+    if(predict(levels[i], numPixels) <= budget) {
+      fitting = i;
+      break;
+    }
+  }
+
+  if(fitting > level) {
+    applyLevel(fitting);
+    framesFitting = 0;
+  }
+  else if(fitting < level) {
+    // Step up one level at a time, once a better one has fit for a
+    // while.
+    if(++framesFitting >= upgradeFrames) {
+      applyLevel(level - 1);
+      framesFitting = 0;
+    }
+  }
+  else {
+    framesFitting = 0;
+  }
+}
+
+void DeadlineSegmenter::applyLevel(int next) {
+  const QualityLevel& from = levels[level];
+  const QualityLevel& to = levels[next];
+  if(from.numPlanes != to.numPlanes) {
+    int most = max(from.numPlanes, to.numPlanes);
+    if((int)planeSets.size() <= most) planeSets.resize(most + 1);
+    planeSets[from.numPlanes] = session.planes;
+    if(planeSets[to.numPlanes].empty())
+      planeSets[to.numPlanes] = makeRandomPlanes(to.numPlanes, numChannels,
+                                                 session.ctx.rng);
+    session.planes = planeSets[to.numPlanes];
+  }
+  if(from.numPlanes != to.numPlanes || from.hammingK != to.hammingK) {
+    session.hammingK = to.hammingK;
+    session.reset();
+  }
+  session.maxRetries = to.maxRetries;
+  level = next;
+}
+
+// Fold the timings of a frame segmented with [q] into the fitted
+// stage costs.
+void DeadlineSegmenter::fitCosts(const QualityLevel& q, size_t numPixels,
+                                 const StageTimings& t, bool keyFrame) {
+  float pixels = numPixels * q.scale * q.scale;
+  float samples[4] = { -1.0f, -1.0f, -1.0f, -1.0f };
+  float* costs[4] = { &resizeCost, &hashCost, &labelCost, &simplifyCost };
+  if(q.scale < 1.0f) samples[0] = t.resizeMs / numPixels;
+  // Warm frames cost less than key frames, which are what is planned
+  // for, so they are left out of the fit.
+  if(keyFrame) samples[1] = t.hashMs / (pixels * q.numPlanes * q.maxRetries);
+  samples[2] = t.labelMs / pixels;
+  if(q.simplify) samples[3] = t.simplifyMs / pixels;
+  for(int s = 0; s < 4; s++) {
+    if(samples[s] < 0.0f) continue;
+    float& cost = *costs[s];
+    cost = cost < 0.0f ? samples[s]
+                       : cost + COST_SMOOTHING * (samples[s] - cost);
+  }
+}
+
+int DeadlineSegmenter::segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+                               cv::Mat& labels) {
+  size_t numPixels = (size_t)imgIn.rows * imgIn.cols;
+  chooseLevel(numPixels);
+  const QualityLevel& q = levels[level];
+  bool scaled = q.scale < 1.0f;
+
+  StageTimings t = { 0.0f, 0.0f, 0.0f, 0.0f };
+  struct timeval start, stop;
+  gettimeofday(&start, NULL);
+  cv::Size size(max(1, (int)(imgIn.cols * q.scale + 0.5f)),
+                max(1, (int)(imgIn.rows * q.scale + 0.5f)));
+  if(scaled) {
+    cv::resize(imgIn, scaledIn, size, 0, 0, CV_INTER_AREA);
+    if(imgColor.data == imgIn.data) scaledColor = scaledIn;
+    else cv::resize(imgColor, scaledColor, size, 0, 0, CV_INTER_AREA);
+    gettimeofday(&stop, NULL);
+    t.resizeMs = elapsedMs(start, stop);
+    start = stop;
+  }
+  const cv::Mat& hashIn = scaled ? scaledIn : imgIn;
+  const cv::Mat& colorIn = scaled ? scaledColor : imgColor;
+  cv::Mat& codes = scaled ? scaledCodes : labels;
+
+  int numMaxima = session.hash(hashIn, codes);
+  gettimeofday(&stop, NULL);
+  t.hashMs = elapsedMs(start, stop);
+  start = stop;
+
+  int numComponents = 0;
+  if(numMaxima) {
+    numComponents = findComponents(codes);
+    gettimeofday(&stop, NULL);
+    t.labelMs = elapsedMs(start, stop);
+    start = stop;
+
+    if(q.simplify) {
+      simplify(colorIn, codes, numComponents);
+      gettimeofday(&stop, NULL);
+      t.simplifyMs = elapsedMs(start, stop);
+      start = stop;
+    }
+
+    if(scaled) {
+      cv::resize(scaledCodes, labels, cv::Size(imgIn.cols, imgIn.rows),
+                 0, 0, CV_INTER_NEAREST);
+      gettimeofday(&stop, NULL);
+      t.resizeMs += elapsedMs(start, stop);
+    }
+  }
+
+  bool keyFrame = !session.lastFrameWarm;
+  if(numMaxima) fitCosts(q, numPixels, t, keyFrame);
+  lastFrame.level = level;
+  lastFrame.settings = q;
+  lastFrame.predictedMs = predict(q, numPixels);
+  lastFrame.timings = t;
+  lastFrame.keyFrame = keyFrame;
+  return numComponents;
+}
@@ -0,0 +1,184 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include "EnsembleSegmentation.h"
+#include "Connected.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes);
+
+EnsembleSegmenter::EnsembleSegmenter(int numTrials, int numPlanes,
+                                     uint32_t hammingK, int maxRetries,
+                                     int numChannels, uint64_t seed)
+  : hammingK(hammingK), maxRetries(maxRetries), simplify(true),
+    edgeScale(2.0f), minEdgeContrast(8), bestTrial(-1), seed(seed) {
+  for(int t = 0; t < numTrials; t++) {
+    EnsembleTrial* trial = new EnsembleTrial();
+    trial->ctx.rng.seed(seed, t);
+    trial->startPlanes = makeRandomPlanes(numPlanes, numChannels,
+                                          trial->ctx.rng);
+    trial->numMaxima = trial->numComponents = trial->numRegions = 0;
+    trial->precision = trial->recall = trial->score = 0.0f;
+    trials.push_back(trial);
+  }
+}
+
+EnsembleSegmenter::~EnsembleSegmenter() {
+  for(size_t t = 0; t < trials.size(); t++) delete trials[t];
+}
+
+// The sum of the absolute differences of the [n] channels of two
+// pixels.
+static inline int contrast(const uint8_t* a, const uint8_t* b, int n) {
+  int sum = 0;
+  for(int c = 0; c < n; c++) sum += abs((int)a[c] - (int)b[c]);
+  return sum;
+}
+
+void EnsembleSegmenter::findEdges(const cv::Mat& imgColor) {
+  int rows = imgColor.rows, cols = imgColor.cols;
+  int n = imgColor.channels();
+  edgesRight.create(rows, cols, CV_8U);
+  edgesDown.create(rows, cols, CV_8U);
+
+  // The threshold is relative to the image's mean contrast, so that
+  // low contrast images still have edges.
+  double total = 0.0;
+  #pragma omp parallel for reduction(+:total)
+  for(int y = 0; y < rows; y++) {
+    const uint8_t* row = imgColor.ptr(y);
+    const uint8_t* below = imgColor.ptr(min(y + 1, rows - 1));
+    int64_t sum = 0;
+    for(int x = 0; x + 1 < cols; x++)
+      sum += contrast(row + x*n, row + (x + 1)*n, n);
+    if(y + 1 < rows)
+      for(int x = 0; x < cols; x++)
+        sum += contrast(row + x*n, below + x*n, n);
+    total += sum;
+  }
+  size_t pairs = (size_t)rows*(cols - 1) + (size_t)(rows - 1)*cols;
+  int threshold = max(minEdgeContrast,
+                      (int)(edgeScale * total / max((size_t)1, pairs)));
+
+  #pragma omp parallel for
+  for(int y = 0; y < rows; y++) {
+    const uint8_t* row = imgColor.ptr(y);
+    const uint8_t* below = imgColor.ptr(min(y + 1, rows - 1));
+    uint8_t* right = edgesRight.ptr(y);
+    uint8_t* down = edgesDown.ptr(y);
+    for(int x = 0; x < cols; x++) {
+      right[x] = x + 1 < cols &&
+                 contrast(row + x*n, row + (x + 1)*n, n) > threshold;
+      down[x] = y + 1 < rows &&
+                contrast(row + x*n, below + x*n, n) > threshold;
+    }
+  }
+}
+
+// Compare the boundaries of [trial]'s labels with the edges found by
+// findEdges. A boundary between two pixels is precise if they lie
+// across an edge; an edge is recalled if there is a boundary between
+// the same pixels or between the parallel pair beside them, since
+// blurred edges are often wider than a pixel.
+void EnsembleSegmenter::scoreTrial(EnsembleTrial& trial) const {
+  const cv::Mat& labels = trial.labels;
+  int rows = labels.rows, cols = labels.cols;
+  int64_t boundaries = 0, onEdges = 0, edges = 0, recalled = 0;
+  for(int y = 0; y < rows; y++) {
+    const int* row = (const int*)labels.ptr(y);
+    const int* above = y > 0 ? (const int*)labels.ptr(y - 1) : NULL;
+    const int* below = y + 1 < rows ? (const int*)labels.ptr(y + 1) : NULL;
+    const int* below2 = y + 2 < rows ? (const int*)labels.ptr(y + 2) : NULL;
+    const uint8_t* right = edgesRight.ptr(y);
+    const uint8_t* down = edgesDown.ptr(y);
+    for(int x = 0; x + 1 < cols; x++) {
+      bool boundary = row[x] != row[x + 1];
+      boundaries += boundary;
+      onEdges += boundary && right[x];
+      if(right[x]) {
+        edges++;
+        recalled += boundary ||
+                    (x > 0 && row[x - 1] != row[x]) ||
+                    (x + 2 < cols && row[x + 1] != row[x + 2]);
+      }
+    }
+    if(!below) continue;
+    for(int x = 0; x < cols; x++) {
+      bool boundary = row[x] != below[x];
+      boundaries += boundary;
+      onEdges += boundary && down[x];
+      if(down[x]) {
+        edges++;
+        recalled += boundary ||
+                    (above && above[x] != row[x]) ||
+                    (below2 && below[x] != below2[x]);
+      }
+    }
+  }
+
+  trial.precision = boundaries ? (float)onEdges / boundaries : 0.0f;
+  // An image without edges is best left whole.
+  trial.recall = edges ? (float)recalled / edges : 1.0f;
+  if(!edges && !boundaries) trial.precision = 1.0f;
+  float sum = trial.precision + trial.recall;
+  trial.score = sum > 0.0f ? 2.0f * trial.precision * trial.recall / sum
+                           : 0.0f;
+}
+
+void EnsembleSegmenter::runTrial(int t, const cv::Mat& imgIn,
+                                 const cv::Mat& imgColor) {
+  EnsembleTrial& trial = *trials[t];
+  trial.ctx.rng.seed(seed, t);
+  trial.planes = trial.startPlanes;
+  trial.numMaxima = hammingHash(trial.ctx, imgIn, trial.labels,
+                                trial.planes, hammingK, maxRetries);
+  trial.numComponents = trial.numRegions = 0;
+  trial.precision = trial.recall = trial.score = 0.0f;
+  if(!trial.numMaxima) return;
+  trial.numComponents = findComponents(trial.labels);
+  trial.numRegions = trial.numComponents;
+  if(simplify)
+    trial.numRegions = ::simplify(imgColor, trial.labels,
+                                  trial.numComponents);
+  scoreTrial(trial);
+}
+
+int EnsembleSegmenter::segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+                               cv::Mat& labels) {
+  int numTrials = trials.size();
+  bestTrial = -1;
+  if(numTrials == 0) return 0;
+  findEdges(imgColor);
+
+  // Trials run one per thread. Threads left over when there are fewer
+  // trials than threads are shared out among the trials' own stages,
+  // which only use them if nested parallelism is enabled.
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  int outerThreads = min(numTrials, maxThreads);
+  #pragma omp parallel for schedule(dynamic, 1) num_threads(outerThreads)
+  for(int t = 0; t < numTrials; t++) {
+#ifdef _OPENMP
+    omp_set_num_threads(max(1, maxThreads / outerThreads));
+#endif
+    runTrial(t, imgIn, imgColor);
+  }
+
+  // Ties go to the earliest trial, so that the choice does not depend
+  // on the order in which trials finished.
+  for(int t = 0; t < numTrials; t++) {
+    if(!trials[t]->numMaxima) continue;
+    if(bestTrial < 0 || trials[t]->score > trials[bestTrial]->score)
+      bestTrial = t;
+  }
+  if(bestTrial < 0) return 0;
+  trials[bestTrial]->labels.copyTo(labels);
+  return trials[bestTrial]->numRegions;
+}
@@ -0,0 +1,74 @@
+#include "HammingDistance.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+// Portable kernels. Unless the compiler is told it may use POPCNT,
+// __builtin_popcount becomes a library call or a bit-twiddling
+// sequence.
+
+static void distances64Generic(uint64_t code, const uint64_t* codes,
+                               int n, uint8_t* distances) {
+  for(int i = 0; i < n; i++)
+    distances[i] = __builtin_popcountll(codes[i] ^ code);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// The same loop, compiled to use the POPCNT instruction.
+
+__attribute__((target("popcnt")))
+static void distances64POPCNT(uint64_t code, const uint64_t* codes,
+                              int n, uint8_t* distances) {
+  for(int i = 0; i < n; i++)
+    distances[i] = __builtin_popcountll(codes[i] ^ code);
+}
+
+// AVX-512 kernel: XOR a register of codes with the broadcast code,
+// count the bits of every lane at once, and narrow the counts to
+// bytes.
+
+__attribute__((target("popcnt,avx512f,avx512vpopcntdq")))
+static void distances64AVX512(uint64_t code, const uint64_t* codes,
+                              int n, uint8_t* distances) {
+  __m512i c = _mm512_set1_epi64(code);
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512(codes + i), c);
+    _mm_storel_epi64((__m128i*)(distances + i),
+                     _mm512_cvtepi64_epi8(_mm512_popcnt_epi64(x)));
+  }
+  for(; i < n; i++)
+    distances[i] = __builtin_popcountll(codes[i] ^ code);
+}
+
+#endif
+
+PopcountISA detectPopcountISA() {
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512vpopcntdq")) return POPCOUNT_AVX512;
+  if(__builtin_cpu_supports("popcnt")) return POPCOUNT_POPCNT;
+#endif
+  return POPCOUNT_GENERIC;
+}
+
+const HammingDistanceKernels& hammingDistanceKernels(PopcountISA isa) {
+  static const PopcountISA best = detectPopcountISA();
+  static const HammingDistanceKernels kernels[] = {
+    { distances64Generic },
+#ifdef HAVE_X86_KERNELS
+    { distances64POPCNT },
+    { distances64AVX512 }
+#endif
+  };
+  return kernels[isa > best ? best : isa];
+}
+
+const HammingDistanceKernels& hammingDistanceKernels() {
+  static const HammingDistanceKernels& kernels =
+    hammingDistanceKernels(detectPopcountISA());
+  return kernels;
+}
@@ -1,17 +1,24 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
-#include <set>
-#include "HammingNeighborhoodFilters.h"
+#include <algorithm>
+#include <time.h>
+#include "HammingHash.h"
+#include "ProjectionKernels.h"
+#include "SparseHistogram.h"
+#include "Instrumentation.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
-inline void randomUnitVector(int dims, float* v) {
+inline void randomUnitVector(int dims, float* v, RandomGenerator& rng) {
   float* p;
   while(1) {
     float len = 0.0f;
     p = v;
     for(int i = 0; i < dims; i++, p++) {
-      float r = ((rand() / (float)RAND_MAX) - 0.5) * 2.0;
+      float r = rng.uniformSigned();
       len += r*r;
       *p = r;
     }
@@ -25,206 +32,422 @@ inline void randomUnitVector(int dims, float* v) {
   }
 }
 
-inline void randomizeAllPlanes(int numPlanes, int dims, float* vs) {
+inline void randomizeAllPlanes(int numPlanes, int dims, float* vs,
+                               RandomGenerator& rng) {
   for(;numPlanes > 0; numPlanes--, vs += dims) {
-    randomUnitVector(dims, vs);
+    randomUnitVector(dims, vs, rng);
   }
 }
 
 // Produce [numPlanes] random vectors, each of dimension [numDimensions].
-vector<float> makeRandomPlanes(int numPlanes, int numDimensions) {
+vector<float> makeRandomPlanes(int numPlanes, int numDimensions,
+                               RandomGenerator& rng) {
   vector<float> planes(numPlanes*numDimensions);
-  randomizeAllPlanes(numPlanes, numDimensions, &planes[0]);
+  randomizeAllPlanes(numPlanes, numDimensions, &planes[0], rng);
   return planes;
 }
 
-inline uint32_t hammingDistance(uint32_t x, uint32_t y)
-{
-    uint32_t dist = 0;
-    uint32_t r = x ^ y;
-    for(dist = 0; r; dist++) r &= r - 1;
-    return dist;
+// Seconds on a monotonic clock, for stage timings.
+static inline double stageClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
 }
 
-// Compute per-pixel projections
+// If [ctx] times its stages, add the time since [mark] to the stage
+// total [total], and restart [mark].
+static inline void lapStage(const SegmentationContext& ctx,
+                            double& total, double& mark) {
+  if(!ctx.timeStages) return;
+  double now = stageClock();
+  total += now - mark;
+  mark = now;
+}
+
+static inline double startStage(const SegmentationContext& ctx) {
+  return ctx.timeStages ? stageClock() : 0.0;
+}
+
+// Compute per-pixel projections with [projectRow], which is either a
+// floating point kernel over a PlaneLayout or the table-driven kernel
+// over a ProjectionTable. If [projections] is NULL, only the per-plane
+// extrema are computed.
+template<typename T, typename Layout, typename ProjectRow>
 inline void projectPixels(const cv::Mat& imgIn,
-                          const vector<float>& planes,
-                          float* projections,
-                          vector<float>& minimums,
-                          vector<float>& maximums) {
-  int numChannels = imgIn.channels();
-  int numPlanes = planes.size() / numChannels;
-  float** minRows = (float**)malloc(sizeof(float*)*imgIn.rows);
-  float** maxRows = (float**)malloc(sizeof(float*)*imgIn.rows);
+                          const Layout& layout,
+                          ProjectRow projectRow,
+                          T* projections,
+                          vector<T>& minimums,
+                          vector<T>& maximums) {
+  int numPlanes = layout.numPlanes;
+  int stride = layout.paddedPlanes;
+  // Each row tracks its own extrema, which are then combined.
+  vector<T> rowExtrema(2*(size_t)imgIn.rows*stride, 0);
   
   #pragma omp parallel for
   for(int y = 0; y < imgIn.rows; y ++) {
-    const uchar* row = imgIn.ptr(y);
-    // HACK: we almost always have 3 color channels. Allocate 4 for
-    // good luck.
-    float pixelBuffer[4];
-    float* minRow = (float*)malloc(sizeof(float)*numPlanes);
-    memset(minRow, 0, sizeof(float)*numPlanes);
-    float* maxRow = (float*)malloc(sizeof(float)*numPlanes);
-    memset(maxRow, 0, sizeof(float)*numPlanes);
-
-    float* projPtr = &projections[y*numPlanes*imgIn.cols];
-    for(int x = 0, p = 0; x < imgIn.cols; x++) {
-      for(int d = 0; d < numChannels; d++, row++) {
-        pixelBuffer[d] = (float)(*row) - 128.0f;
-      }
-
-      const float* planePtr = &planes[0];
-      for(int plane = 0; plane < numPlanes; plane++) {
-        float sum = 0.0f;
-        for(int d = 0; d < numChannels; d++, planePtr++)
-          sum += pixelBuffer[d] * (*planePtr);
-        *(projPtr++) = sum;
-        if(sum > maxRow[plane]) maxRow[plane] = sum;
-        if(sum < minRow[plane]) minRow[plane] = sum;
-      }
-    }
-    minRows[y] = minRow;
-    maxRows[y] = maxRow;
+    T* minRow = &rowExtrema[2*(size_t)y*stride];
+    T* maxRow = minRow + stride;
+    T* projPtr = projections ? 
+                 &projections[(size_t)y*numPlanes*imgIn.cols] : NULL;
+    projectRow(layout, imgIn.ptr(y), imgIn.cols, projPtr, minRow, maxRow);
   }
   
-  memcpy(&(minimums[0]), minRows[0], sizeof(float)*numPlanes);
-  memcpy(&(maximums[0]), maxRows[0], sizeof(float)*numPlanes);
-
-  free(minRows[0]);
-  free(maxRows[0]);
+  memcpy(&(minimums[0]), &rowExtrema[0], sizeof(T)*numPlanes);
+  memcpy(&(maximums[0]), &rowExtrema[stride], sizeof(T)*numPlanes);
 
   for(int y = 1; y < imgIn.rows; y++) {
-    float* minRow = minRows[y];
-    float* maxRow = maxRows[y];
+    const T* minRow = &rowExtrema[2*(size_t)y*stride];
+    const T* maxRow = minRow + stride;
     for(int plane = 0; plane < numPlanes; plane++) {
       if(minRow[plane] < minimums[plane])
         minimums[plane] = minRow[plane];
       if(maxRow[plane] > maximums[plane])
         maximums[plane] = maxRow[plane];
     }
-    free(minRow);
-    free(maxRow);
-  }
-
-  free(minRows);
-  free(maxRows);
-}
-
-// Compute the midpoint of the extrema of the projections for each
-// plane.
-inline void encodeProjections(const vector<float>& minimums,
-                              const vector<float>& maximums,
-                              const float* projections,
-                              const cv::Mat& imgIn,
-                              cv::Mat& imgOut,
-                              float* binColors,
-                              vector<uint32_t>& bins) {
-  int numPlanes = minimums.size();
-  //vector<float> midpoints(numPlanes);
-  float midpoints[numPlanes];
-  for(int plane = 0; plane < numPlanes; plane++)
-    midpoints[plane] = (maximums[plane]+minimums[plane]) * 0.5f;
-
-  // Encode the per-pixel projections using midpoint information.
-  for(int y = 0; y < imgOut.rows; y++) {
-    //int* row = imgOut.ptr(y);
-    uint32_t* row = ((uint32_t*)imgOut.data) + y*imgOut.cols;
-    uint8_t* color = (uint8_t*)imgIn.ptr(y);
-    const float* projRow = &(projections[y * imgOut.cols * numPlanes]);
-    for(int x = 0; x < imgOut.cols; x++, row++, color+=3) {
-      uint32_t code = 0;
-      for(uint32_t plane = 0, mask = 1; 
-          plane < numPlanes; 
-          plane++, mask *= 2, projRow++) {
-        if(*projRow > midpoints[plane]) code |= mask;
+  }
+}
+
+// Accumulate a row of codes and the colors of the pixels that
+// produced them into a histogram. Colors are summed as integers so
+// that the totals do not depend on the order in which rows are
+// binned. At most 3 channels are summed. Codes seen for the first
+// time are appended to [active].
+inline void binRow(const uint32_t* codes, const uint8_t* color,
+                   int cols, int numChannels,
+                   uint64_t* colorSums, uint32_t* bins,
+                   vector<uint32_t>& active) {
+  if(numChannels >= 3) {
+    for(int x = 0; x < cols; x++, color += numChannels) {
+      uint32_t code = codes[x];
+      if(bins[code]++ == 0) active.push_back(code);
+      uint64_t* sum = &colorSums[code*3];
+      sum[0] += color[0];
+      sum[1] += color[1];
+      sum[2] += color[2];
+    }
+    return;
+  }
+  for(int x = 0; x < cols; x++, color += numChannels) {
+    uint32_t code = codes[x];
+    if(bins[code]++ == 0) active.push_back(code);
+    uint64_t* sum = &colorSums[code*3];
+    for(int d = 0; d < numChannels; d++) sum[d] += color[d];
+  }
+}
+
+// Produces the Hamming codes of one row of an image. Codes come from
+// stored projections when there are any, and otherwise are computed
+// from the pixels directly. In the latter case the dot product of each
+// pixel with each plane is recomputed exactly as projectPixels
+// computes it, so the codes are the same either way.
+struct RowEncoder {
+  const cv::Mat* imgIn;
+  const ProjectionKernels* kernels;
+  const PlaneLayout* layout;
+  const float* projections;
+  const ProjectionTable* table;
+  const int16_t* intProjections;
+  bool useTable;
+
+  void operator()(int y, uint32_t* codes) const {
+    encodeSpan(y, 0, imgIn->cols, codes);
+  }
+
+  // Encode the [n] pixels of row [y] starting at column [x].
+  void encodeSpan(int y, int x, int n, uint32_t* codes) const {
+    size_t first = (size_t)y*imgIn->cols + x;
+    const uint8_t* pixels = imgIn->ptr(y) + x*imgIn->channels();
+    if(useTable) {
+      if(intProjections)
+        encodeRowLUT(*table, intProjections + first*table->numPlanes,
+                     n, codes);
+      else
+        projectEncodeRowLUT(*table, pixels, n, codes);
+    }
+    else {
+      if(projections)
+        kernels->encodeRow(*layout, projections + first*layout->numPlanes,
+                           n, codes);
+      else
+        kernels->projectEncodeRow(*layout, pixels, n, codes);
+    }
+  }
+};
+
+// Encode every row of [imgIn], storing the codes in [imgOut] and
+// their histogram in [ctx.bins] and [ctx.binColors]. Each thread
+// encodes a band of rows into a private histogram, noting each code
+// it sees for the first time. The private histograms are then summed
+// in parallel over the union of those codes, which becomes
+// [ctx.activeBins]. Since colors are summed as integers, the result
+// is identical whatever the number of threads.
+//
+// Private histograms are dense for up to [ctx.maxThreadBinPlanes]
+// planes. Only their occupied entries are ever touched: [ctx.bins] is
+// zero outside [ctx.activeBins], and the private histograms are
+// entirely zero between calls, so clearing them costs no more than
+// filling them. Above that, a dense copy per thread would cost more
+// memory (and page faults) than the encoding itself, so each thread
+// counts its codes in a SparseHistogram instead.
+inline void encodeRows(SegmentationContext& ctx,
+                       const RowEncoder& encodeRow,
+                       const cv::Mat& imgIn,
+                       cv::Mat& imgOut) {
+  size_t numBins = ctx.bins.size();
+  int numChannels = imgIn.channels();
+  bool dense = numBins <= ((size_t)1 << ctx.maxThreadBinPlanes);
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  if(dense) {
+    ctx.threadBins.resize(maxThreads*numBins, 0);
+    ctx.threadColorSums.resize(maxThreads*numBins*3, 0);
+    ctx.threadActiveBins.resize(maxThreads);
+  }
+  else ctx.threadSparseBins.resize(maxThreads);
+
+  // Forget the previous histogram.
+  vector<uint32_t>& active = ctx.activeBins;
+  for(int i = 0; i < active.size(); i++) ctx.bins[active[i]] = 0;
+  active.clear();
+
+  int numThreads = 1;
+  #pragma omp parallel
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    #pragma omp single
+    numThreads = omp_get_num_threads();
+#endif
+    if(dense) {
+      uint32_t* bins = &ctx.threadBins[thread*numBins];
+      uint64_t* colorSums = &ctx.threadColorSums[thread*numBins*3];
+      vector<uint32_t>& seen = ctx.threadActiveBins[thread];
+      seen.clear();
+
+      #pragma omp for schedule(static)
+      for(int y = 0; y < imgOut.rows; y++) {
+        uint32_t* row = ((uint32_t*)imgOut.data) + y*imgOut.cols;
+        encodeRow(y, row);
+        binRow(row, imgIn.ptr(y), imgOut.cols, numChannels,
+               colorSums, bins, seen);
       }
-      *row = code;
-      bins[code]++;
-      binColors[code*3] += (float)*color;
-      binColors[code*3+1] += (float)*(color+1);
-      binColors[code*3+2] += (float)*(color+2);
     }
+    else {
+      SparseHistogram& histogram = ctx.threadSparseBins[thread];
+      histogram.clear();
+
+      #pragma omp for schedule(static)
+      for(int y = 0; y < imgOut.rows; y++) {
+        uint32_t* row = ((uint32_t*)imgOut.data) + y*imgOut.cols;
+        encodeRow(y, row);
+        const uint8_t* color = imgIn.ptr(y);
+        for(int x = 0; x < imgOut.cols; x++, color += numChannels)
+          histogram.add(row[x], color, numChannels);
+      }
+    }
+  }
+
+  // Gather the codes seen by any thread, using [ctx.bins] to weed out
+  // duplicates, and sort them so that later stages visit codes in
+  // ascending order.
+  for(int t = 0; t < numThreads; t++) {
+    if(dense) {
+      const vector<uint32_t>& seen = ctx.threadActiveBins[t];
+      for(int i = 0; i < seen.size(); i++) {
+        if(ctx.bins[seen[i]]) continue;
+        ctx.bins[seen[i]] = 1;
+        active.push_back(seen[i]);
+      }
+      continue;
+    }
+    const vector<uint64_t>& seen = ctx.threadSparseBins[t].codes;
+    for(size_t i = 0; i < seen.size(); i++) {
+      if(ctx.bins[seen[i]]) continue;
+      ctx.bins[seen[i]] = 1;
+      active.push_back(seen[i]);
+    }
+  }
+  sort(active.begin(), active.end());
+
+  int numActive = active.size();
+  #pragma omp parallel for schedule(static)
+  for(int i = 0; i < numActive; i++) {
+    uint32_t code = active[i];
+    uint32_t count = 0;
+    uint64_t sum[3] = {0, 0, 0};
+    for(int t = 0; t < numThreads; t++) {
+      const uint64_t* threadSum;
+      if(dense) {
+        count += ctx.threadBins[t*numBins + code];
+        threadSum = &ctx.threadColorSums[(t*numBins + code)*3];
+      }
+      else {
+        const SparseHistogram& histogram = ctx.threadSparseBins[t];
+        uint32_t entry = histogram.find(code);
+        if(entry == SparseHistogram::NOT_FOUND) continue;
+        count += histogram.counts[entry];
+        threadSum = &histogram.colorSums[entry*3];
+      }
+      sum[0] += threadSum[0];
+      sum[1] += threadSum[1];
+      sum[2] += threadSum[2];
+    }
+    ctx.bins[code] = count;
+    ctx.binColors[code*3] = (float)sum[0];
+    ctx.binColors[code*3+1] = (float)sum[1];
+    ctx.binColors[code*3+2] = (float)sum[2];
+  }
+  if(!dense) return;
+
+  // Return the private histograms to zero.
+  #pragma omp parallel for schedule(static, 1)
+  for(int t = 0; t < numThreads; t++) {
+    const vector<uint32_t>& seen = ctx.threadActiveBins[t];
+    uint32_t* bins = &ctx.threadBins[t*numBins];
+    uint64_t* colorSums = &ctx.threadColorSums[t*numBins*3];
+    for(int i = 0; i < seen.size(); i++) {
+      bins[seen[i]] = 0;
+      memset(&colorSums[seen[i]*3], 0, sizeof(uint64_t)*3);
+    }
+  }
+}
+
+// An encoder for [imgIn] that computes projections from the pixels,
+// against the planes and midpoints currently held by [ctx].
+static RowEncoder pixelEncoder(SegmentationContext& ctx,
+                               const cv::Mat& imgIn) {
+  RowEncoder encoder;
+  encoder.imgIn = &imgIn;
+  encoder.kernels = &projectionKernels(ctx.isa);
+  encoder.layout = &ctx.layout;
+  encoder.projections = NULL;
+  encoder.table = &ctx.table;
+  encoder.intProjections = NULL;
+  encoder.useTable = ctx.integerProjections;
+  return encoder;
+}
+
+// Project pixels onto the given planes, and encode each pixel by the
+// side of each plane's midpoint its projection falls on. Codes are
+// stored in [imgOut] and their histogram replaces the one held by
+// [ctx]. When streaming, the projection pass only finds the extrema,
+// and projections are recomputed as they are encoded.
+static void projectAndEncode(SegmentationContext& ctx,
+                             const cv::Mat& imgIn, cv::Mat& imgOut,
+                             const vector<float>& planes) {
+  int numChannels = imgIn.channels();
+  RowEncoder encoder = pixelEncoder(ctx, imgIn);
+  double mark = startStage(ctx);
+
+  if(ctx.integerProjections) {
+    // Only planes replaced since the last frame are re-tabulated.
+    ctx.table.update(planes, numChannels);
+    int numPlanes = ctx.table.numPlanes;
+    vector<int16_t> minimums(numPlanes), maximums(numPlanes);
+    int16_t* projections = ctx.streamProjections ? NULL : ctx.intProjections;
+    projectPixels(imgIn, ctx.table, projectRowLUT, 
+                  projections, minimums, maximums);
+    encoder.intProjections = projections;
+    ctx.table.setMidpoints(&minimums[0], &maximums[0]);
+  }
+  else {
+    ctx.layout.setPlanes(planes, numChannels);
+    int numPlanes = ctx.layout.numPlanes;
+    vector<float> minimums(numPlanes), maximums(numPlanes);
+    float* projections = ctx.streamProjections ? NULL : ctx.projections;
+    projectPixels(imgIn, ctx.layout, encoder.kernels->projectRow,
+                  projections, minimums, maximums);
+    encoder.projections = projections;
+    ctx.layout.setMidpoints(&minimums[0], &maximums[0]);
+  }
+  lapStage(ctx, ctx.stageTimes.project, mark);
+
+  encodeRows(ctx, encoder, imgIn, imgOut);
+  lapStage(ctx, ctx.stageTimes.encode, mark);
+}
+
+// Returns true if no code within Hamming distance K of [code] is at
+// least as popular as [code]. Neighbors are visited by flipping K or
+// fewer bits directly, nearest first, so no mask table is needed.
+// Only K is a template parameter: [numPlanes] stays a runtime loop
+// bound, so the loops are not unrolled over the planes, and one
+// instantiation per radius serves every plane count.
+template<int K>
+inline bool isMaximumWithin(const uint32_t* bins, uint32_t code,
+                            uint32_t pop, int numPlanes) {
+  for(int i = numPlanes - 1; i >= 0; i--)
+    if(bins[code ^ (1u << i)] >= pop) return false;
+  if(K < 2) return true;
+  for(int i = numPlanes - 1; i >= 1; i--)
+    for(int j = i - 1; j >= 0; j--)
+      if(bins[code ^ (1u << i) ^ (1u << j)] >= pop) return false;
+  if(K < 3) return true;
+  for(int i = numPlanes - 1; i >= 2; i--)
+    for(int j = i - 1; j >= 1; j--)
+      for(int l = j - 1; l >= 0; l--)
+        if(bins[code ^ (1u << i) ^ (1u << j) ^ (1u << l)] >= pop)
+          return false;
+  return true;
+}
+
+template<int K>
+inline void scanMaxima(const vector<uint32_t>& bins,
+                       const vector<uint32_t>& activeBins,
+                       int numPlanes,
+                       vector<uint32_t>& hMaxima) {
+  for(int a = 0; a < activeBins.size(); a++) {
+    uint32_t i = activeBins[a];
+    if(isMaximumWithin<K>(&bins[0], i, bins[i], numPlanes))
+      hMaxima.push_back(i);
   }
 }
 
-// Compute local maxima in Hamming space
+// Compute local maxima in Hamming space. Only the occupied codes
+// listed in [activeBins] (in ascending order) are considered. Radii up
+// to 3 use the scans above, specialized on the radius; larger radii
+// walk the masks of [neighborhood], which are generated as needed.
 void hammingMaxima(const vector<uint32_t>& bins,
+                   const vector<uint32_t>& activeBins,
                    int numPlanes,
                    int hammingK,
+                   HammingNeighborhood& neighborhood,
                    vector<uint32_t>& hMaxima) {
-  uint32_t *counts = NULL;
-  uint32_t *neighborMasks = NULL;
-  switch(numPlanes) {
+  if(hammingK > numPlanes) hammingK = numPlanes;
+  switch(hammingK) {
+  case 0:
+    // With no neighbors to compare against, every occupied code is its
+    // own maximum.
+    hMaxima.insert(hMaxima.end(), activeBins.begin(), activeBins.end());
+    return;
+  case 1:
+    scanMaxima<1>(bins, activeBins, numPlanes, hMaxima);
+    return;
+  case 2:
+    scanMaxima<2>(bins, activeBins, numPlanes, hMaxima);
+    return;
   case 3:
-    counts = filterCounts3;
-    neighborMasks = filter3;
-    break;
-  case 8:
-    counts = filterCounts8;
-    neighborMasks = filter8;
-    break;
-  case 9:
-    counts = filterCounts9;
-    neighborMasks = filter9;
-    break;
-  case 10:
-    counts = filterCounts10;
-    neighborMasks = filter10;
-    break;
-  case 11:
-    counts = filterCounts11;
-    neighborMasks = filter11;
-    break;
-  case 12:
-    counts = filterCounts12;
-    neighborMasks = filter12;
-    break;
-  case 13:
-    counts = filterCounts13;
-    neighborMasks = filter13;
-    break;
-  case 14:
-    counts = filterCounts14;
-    neighborMasks = filter14;
-    break;
-  }
-  if(counts && neighborMasks) {
-    for(int i = 0; i < bins.size(); i++) {
-      int myPop = bins[i];
-      if(myPop == 0) continue;
-      //if(myPop < 100) continue;
-      bool ismax = true;
-      uint32_t *neighborMask = neighborMasks;
-      for(int j = 0; j < hammingK; j++) {
-        for(int k = 0; k < counts[j]; k++, neighborMask++) {
-          if(bins[(*neighborMask) ^ i] >= myPop) {
-            ismax = false;
-            j = hammingK;
-            break;
-          }
-        }
-      }
-      if(ismax) hMaxima.push_back(i);
-    }
+    scanMaxima<3>(bins, activeBins, numPlanes, hMaxima);
+    return;
   }
-  else {
-    // Fallback only capable of traversing the Hamming-space
-    // 1-neighborhood.
-    for(int i = 0; i < bins.size(); i++) {
-      int myPop = bins[i];
-      if(myPop == 0) continue;
-      bool ismax = true;
-      uint32_t neighbor = 1 << (numPlanes - 1);
-      while(neighbor > 1) {
-        if(bins[neighbor ^ i] >= myPop) {
-          ismax = false;
-          break;
-        }
-        neighbor = neighbor >> 1;
+
+  neighborhood.generate(numPlanes, hammingK);
+  const uint32_t* neighborMasks = &neighborhood.masks[0];
+  uint32_t numNeighbors = neighborhood.countWithin(hammingK);
+  for(int a = 0; a < activeBins.size(); a++) {
+    uint32_t i = activeBins[a];
+    uint32_t myPop = bins[i];
+    bool ismax = true;
+    for(uint32_t j = 0; j < numNeighbors; j++) {
+      if(bins[neighborMasks[j] ^ i] >= myPop) {
+        ismax = false;
+        break;
       }
-      if(ismax) hMaxima.push_back(i);
     }
+    if(ismax) hMaxima.push_back(i);
   }
 }
 
@@ -241,13 +464,62 @@ inline float colorDiff(const float* binColors, uint32_t x, uint32_t y) {
   return sum;
 }
 
-// Compute a mapping from each present Hamming code to a local maximum.
+// Find the maxima nearest to [code] by testing the codes at distance
+// 1, 2, ... from it against the maxima bitset, choosing among ties as
+// mapToMaxima does.
+inline uint32_t nearestMaximum(uint32_t code, int numPlanes,
+                               const float* binColors,
+                               const vector<uint64_t>& maximaBits,
+                               HammingNeighborhood& neighborhood) {
+  for(int r = 1; r <= numPlanes; r++) {
+    neighborhood.generate(numPlanes, r);
+    const uint32_t* masks = &neighborhood.masks[neighborhood.countWithin(r-1)];
+    uint32_t numMasks = neighborhood.counts[r-1];
+    bool found = false;
+    uint32_t bestCenter = 0;
+    float bestColorDiff = 0.0f;
+    for(uint32_t j = 0; j < numMasks; j++) {
+      uint32_t m = code ^ masks[j];
+      if(!(maximaBits[m >> 6] & ((uint64_t)1 << (m & 63)))) continue;
+      float diff = colorDiff(binColors, m, code);
+      if(!found || diff < bestColorDiff ||
+         (diff == bestColorDiff && m < bestCenter)) {
+        found = true;
+        bestCenter = m;
+        bestColorDiff = diff;
+      }
+    }
+    if(found) return bestCenter;
+  }
+  return code;
+}
+
+// Compute a mapping from each present Hamming code to a local
+// maximum. Each code is mapped to the maximum nearest to it in
+// Hamming space, with ties broken in favor of the maximum whose color
+// is closest to that of the code's bin (and then the lowest code).
+//
+// When few codes are occupied relative to the size of the code
+// hypercube, each is resolved by searching outward from it through a
+// bitset of the maxima. Otherwise, distances to the nearest maximum
+// are found with a breadth-first flood of the hypercube seeded from
+// all maxima at once, stored in [search.distances] (where zero marks
+// the maxima themselves). The maxima at distance d from a code are
+// exactly those reached by stepping d times to a neighbor one step
+// closer to a maximum, so the tied candidates for each code are
+// recovered by a short walk downhill. Either way, the cost no longer
+// scales with bins times maxima.
 void mapToMaxima(vector<uint32_t>& bins,
+                 const vector<uint32_t>& activeBins,
                  const vector<uint32_t>& hMaxima,
                  float* binColors,
-                 uint32_t* binMapping) {
-  set<uint32_t> maximaSet(hMaxima.begin(), hMaxima.end());
-  
+                 uint32_t* binMapping,
+                 HammingNeighborhood& neighborhood,
+                 MaximaSearch& search) {
+  if(hMaxima.empty()) return;
+  uint32_t numBins = bins.size();
+  int numPlanes = __builtin_ctz(numBins);
+
   // The maxima map to themselves (this preserves the most popular
   // Hamming codes in the resulting coded image.
   for(int i = 0; i < hMaxima.size(); i++) {
@@ -260,32 +532,86 @@ void mapToMaxima(vector<uint32_t>& bins,
     binColors[x*3+2] *= s;
   }
 
-  for(int i = 0; i < bins.size(); i++) {
-    if(bins[i] == 0) continue;
-    if(maximaSet.find(i) == maximaSet.end()) {
-      // Find the nearest Hamming maximum
-      uint32_t minDist = hammingDistance(hMaxima[0], i);
-      int bestCenter = 0;
-      float bestColorDiff = colorDiff(binColors, hMaxima[0], i);
-      for(int b = 1; b < hMaxima.size(); b++) {
-        uint32_t dist = hammingDistance(hMaxima[b], i);
-        if(dist < minDist) {
-          minDist = dist;
-          bestCenter = b;
-          bestColorDiff = colorDiff(binColors, hMaxima[b], i);
-        }
-        else if(dist == minDist) {
-          float diff = colorDiff(binColors, hMaxima[b], i);
-          if(diff < bestColorDiff) {
-            bestColorDiff = diff;
-            minDist = dist;
-            bestCenter = b;
-          }
+  // Searching outward from a code costs about numPlanes^2 probes if a
+  // maximum lies within distance 2; the flood costs numPlanes probes
+  // per code in the hypercube.
+  if((uint64_t)activeBins.size() * numPlanes < numBins) {
+    vector<uint64_t>& maximaBits = search.maximaBits;
+    maximaBits.resize((numBins + 63) / 64, 0);
+    for(int i = 0; i < hMaxima.size(); i++)
+      maximaBits[hMaxima[i] >> 6] |= (uint64_t)1 << (hMaxima[i] & 63);
+
+    for(int a = 0; a < activeBins.size(); a++) {
+      uint32_t i = activeBins[a];
+      if(maximaBits[i >> 6] & ((uint64_t)1 << (i & 63))) continue;
+      uint32_t bestCenter = nearestMaximum(i, numPlanes, binColors,
+                                           maximaBits, neighborhood);
+      binMapping[i] = bestCenter;
+      bins[bestCenter] += bins[i];
+    }
+
+    for(int i = 0; i < hMaxima.size(); i++)
+      maximaBits[hMaxima[i] >> 6] = 0;
+    return;
+  }
+
+  vector<uint8_t>& distances = search.distances;
+  vector<uint32_t>& queue = search.queue;
+  distances.assign(numBins, 0xff);
+  queue.resize(numBins);
+  uint32_t head = 0, tail = 0;
+  for(int i = 0; i < hMaxima.size(); i++) {
+    distances[hMaxima[i]] = 0;
+    queue[tail++] = hMaxima[i];
+  }
+
+  // Flood outward from the maxima until every present code has been
+  // reached. Since the flood proceeds one distance at a time, every
+  // code closer than the last one reached has its distance set.
+  uint32_t pending = activeBins.size() - hMaxima.size();
+  while(head < tail && pending) {
+    uint32_t code = queue[head++];
+    uint8_t d = distances[code] + 1;
+    for(int bit = 0; bit < numPlanes; bit++) {
+      uint32_t neighbor = code ^ (1u << bit);
+      if(distances[neighbor] != 0xff) continue;
+      distances[neighbor] = d;
+      queue[tail++] = neighbor;
+      if(bins[neighbor]) pending--;
+    }
+  }
+
+  vector<uint32_t> candidates, next;
+  for(int a = 0; a < activeBins.size(); a++) {
+    uint32_t i = activeBins[a];
+    if(distances[i] == 0) continue;
+
+    // Walk downhill to collect every nearest maximum, in ascending
+    // order.
+    candidates.assign(1, i);
+    for(int d = distances[i] - 1; d >= 0; d--) {
+      next.clear();
+      for(int c = 0; c < candidates.size(); c++)
+        for(int bit = 0; bit < numPlanes; bit++) {
+          uint32_t neighbor = candidates[c] ^ (1u << bit);
+          if(distances[neighbor] == d) next.push_back(neighbor);
         }
+      sort(next.begin(), next.end());
+      next.erase(unique(next.begin(), next.end()), next.end());
+      candidates.swap(next);
+    }
+
+    uint32_t bestCenter = candidates[0];
+    float bestColorDiff = colorDiff(binColors, bestCenter, i);
+    for(int c = 1; c < candidates.size(); c++) {
+      float diff = colorDiff(binColors, candidates[c], i);
+      if(diff < bestColorDiff) {
+        bestColorDiff = diff;
+        bestCenter = candidates[c];
       }
-      binMapping[i] = binMapping[hMaxima[bestCenter]];
-      bins[hMaxima[bestCenter]] += bins[i];
     }
+    binMapping[i] = bestCenter;
+    bins[bestCenter] += bins[i];
   }
 }
 
@@ -293,6 +619,241 @@ void mapToMaxima(vector<uint32_t>& bins,
 // random new one.
 vector<float> discriminativePower(int numPlanes, vector<uint32_t>& maxima);
 vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima);
+vector<float> discriminativePower(int numPlanes, vector<uint64_t>& maxima);
+vector<float> planeCorrelation(int numPlanes, vector<uint64_t>& maxima);
+
+SegmentationContext::SegmentationContext()
+  : isa(detectProjectionISA()), streamProjections(false),
+    integerProjections(false), maxDensePlanes(20), maxThreadBinPlanes(16),
+    timeStages(false),
+    projections(0L), intProjections(0L),
+    binMapping(0L), binColors(0L),
+    projectionsCapacity(0), intProjectionsCapacity(0), binCapacity(0) {
+  memset(&stageTimes, 0, sizeof(stageTimes));
+}
+
+SegmentationContext::~SegmentationContext() {
+  if(projections) free(projections);
+  if(intProjections) free(intProjections);
+  if(binMapping) free(binMapping);
+  if(binColors) free(binColors);
+}
+
+size_t SegmentationContext::allocatedBytes() const {
+  size_t bytes = projectionsCapacity*sizeof(float) +
+                 intProjectionsCapacity*sizeof(int16_t) +
+                 binCapacity*(sizeof(uint32_t) + 3*sizeof(float));
+  bytes += bins.capacity()*sizeof(uint32_t) +
+           activeBins.capacity()*sizeof(uint32_t) +
+           threadBins.capacity()*sizeof(uint32_t) +
+           threadColorSums.capacity()*sizeof(uint64_t) +
+           wideCodes.capacity()*sizeof(uint64_t) +
+           sparseMapping.capacity()*sizeof(uint32_t) +
+           search.maximaBits.capacity()*sizeof(uint64_t) +
+           search.distances.capacity() +
+           search.queue.capacity()*sizeof(uint32_t);
+  for(size_t t = 0; t < threadActiveBins.size(); t++)
+    bytes += threadActiveBins[t].capacity()*sizeof(uint32_t);
+  return bytes;
+}
+
+void SegmentationContext::reserve(int rows, int cols, int numPlanes) {
+  if(numPlanes > maxDensePlanes) {
+    // Codes are always computed from the pixels, and are counted in
+    // sparse histograms.
+    wideCodes.resize((size_t)rows * cols);
+    return;
+  }
+
+  size_t numProjections = (size_t)rows * cols * numPlanes;
+  if(!streamProjections) {
+    if(integerProjections && numProjections > intProjectionsCapacity) {
+      if(intProjections) free(intProjections);
+      intProjections = (int16_t*)malloc(sizeof(int16_t)*numProjections);
+      intProjectionsCapacity = numProjections;
+    }
+    else if(!integerProjections && numProjections > projectionsCapacity) {
+      if(projections) free(projections);
+      projections = (float*)malloc(sizeof(float)*numProjections);
+      projectionsCapacity = numProjections;
+    }
+  }
+
+  size_t numBins = (size_t)1 << numPlanes;
+  if(bins.size() != numBins) {
+    // Codes recorded for a histogram of another size mean nothing now.
+    bins.assign(numBins, 0);
+    activeBins.clear();
+  }
+  if(numBins > binCapacity) {
+    if(binMapping) free(binMapping);
+    binMapping = (uint32_t*)malloc(sizeof(uint32_t)*numBins);
+    if(binColors) free(binColors);
+    binColors = (float*)malloc(sizeof(float)*3*numBins);
+    binCapacity = numBins;
+  }
+}
+
+// Project pixels onto more than 32 planes, computing codes 32 planes
+// at a time with the ordinary row kernels: [ctx.layout] holds planes
+// 0-31 and [ctx.highLayout] any planes beyond. Codes are stored in
+// [ctx.wideCodes] and counted in [ctx.sparseBins], whose entries end
+// up sorted by code. Projections are never stored.
+static void projectAndEncodeWide(SegmentationContext& ctx,
+                                 const cv::Mat& imgIn,
+                                 const vector<float>& planes) {
+  int numChannels = imgIn.channels();
+  int numPlanes = planes.size() / numChannels;
+  int numWords = (numPlanes + 31) / 32;
+  const ProjectionKernels& kernels = projectionKernels(ctx.isa);
+  PlaneLayout* layouts[2] = { &ctx.layout, &ctx.highLayout };
+  double mark = startStage(ctx);
+
+  for(int w = 0; w < numWords; w++) {
+    int first = w*32;
+    int last = min(numPlanes, first + 32);
+    vector<float> wordPlanes(planes.begin() + first*numChannels,
+                             planes.begin() + last*numChannels);
+    layouts[w]->setPlanes(wordPlanes, numChannels);
+    vector<float> minimums(last - first), maximums(last - first);
+    projectPixels(imgIn, *layouts[w], kernels.projectRow,
+                  (float*)NULL, minimums, maximums);
+    layouts[w]->setMidpoints(&minimums[0], &maximums[0]);
+  }
+  lapStage(ctx, ctx.stageTimes.project, mark);
+
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  ctx.threadSparseBins.resize(maxThreads);
+
+  int numThreads = 1;
+  #pragma omp parallel
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    #pragma omp single
+    numThreads = omp_get_num_threads();
+#endif
+    SparseHistogram& histogram = ctx.threadSparseBins[thread];
+    histogram.clear();
+    vector<uint32_t> low(imgIn.cols), high(imgIn.cols, 0);
+
+    #pragma omp for schedule(static)
+    for(int y = 0; y < imgIn.rows; y++) {
+      const uint8_t* pixels = imgIn.ptr(y);
+      kernels.projectEncodeRow(ctx.layout, pixels, imgIn.cols, &low[0]);
+      if(numWords > 1)
+        kernels.projectEncodeRow(ctx.highLayout, pixels, imgIn.cols,
+                                 &high[0]);
+      uint64_t* codes = &ctx.wideCodes[(size_t)y*imgIn.cols];
+      const uint8_t* color = pixels;
+      for(int x = 0; x < imgIn.cols; x++, color += numChannels) {
+        codes[x] = low[x] | ((uint64_t)high[x] << 32);
+        histogram.add(codes[x], color, numChannels);
+      }
+    }
+  }
+
+  ctx.sparseBins.clear();
+  for(int t = 0; t < numThreads; t++)
+    ctx.sparseBins.merge(ctx.threadSparseBins[t]);
+  ctx.sparseBins.sortByCode();
+  lapStage(ctx, ctx.stageTimes.encode, mark);
+}
+
+// hammingHash for plane counts above [ctx.maxDensePlanes]. The retry
+// heuristics are the same, but codes are counted in a sparse
+// histogram, and [imgOut] receives the index of each pixel's maximum
+// (in ascending code order) since the codes themselves need not fit
+// in an int.
+static int hammingHashSparse(SegmentationContext& ctx,
+                             const cv::Mat& imgIn, cv::Mat& imgOut,
+                             vector<float>& planes,
+                             uint32_t hammingK,
+                             int maxRetries,
+                             int& attempts) {
+  int numChannels = imgIn.channels();
+  int numPlanes = planes.size() / numChannels;
+  if(numPlanes > 64) return 0;
+
+  ctx.reserve(imgIn.rows, imgIn.cols, numPlanes);
+  SparseHistogram& histogram = ctx.sparseBins;
+
+  vector<uint64_t> hMaxima;
+  int retryCount = 0;
+
+  while(retryCount < maxRetries) {
+    retryCount++;
+    bool hasBadPlane = false;
+
+    projectAndEncodeWide(ctx, imgIn, planes);
+
+    double mark = startStage(ctx);
+    sparseHammingMaxima(histogram, numPlanes, hammingK, hMaxima);
+    lapStage(ctx, ctx.stageTimes.maxima, mark);
+    if(hMaxima.size() < 1) {
+      randomizeAllPlanes(numPlanes, numChannels, &planes[0], ctx.rng);
+      goto KEEP_TRYING;
+    }
+
+    {
+      vector<float> power = discriminativePower(numPlanes, hMaxima);
+      for(int i = 0; i < numPlanes; i++) {
+        if(power[i] < 0.0001) {
+          hasBadPlane = true;
+          randomUnitVector(numChannels, &planes[i*numChannels], ctx.rng);
+        }
+      }
+    }
+    if(hasBadPlane && retryCount < maxRetries) goto KEEP_TRYING;
+
+    {
+      vector<float> correlations = planeCorrelation(numPlanes, hMaxima);
+      for(int i = 0; i < numPlanes; i++) {
+        if(correlations[i] > 0.9f) {
+          hasBadPlane = true;
+          randomUnitVector(numChannels, &planes[i*numChannels], ctx.rng);
+        }
+      }
+    }
+    if(hasBadPlane && retryCount < maxRetries) goto KEEP_TRYING;
+
+    mark = startStage(ctx);
+    sparseMapToMaxima(histogram, hMaxima, ctx.sparseMapping);
+    lapStage(ctx, ctx.stageTimes.map, mark);
+
+    break;
+  KEEP_TRYING:
+    if(retryCount < maxRetries) {
+      hMaxima.clear();
+    } else {
+      double mark = startStage(ctx);
+      sparseMapToMaxima(histogram, hMaxima, ctx.sparseMapping);
+      lapStage(ctx, ctx.stageTimes.map, mark);
+    }
+    continue;
+  }
+  attempts = retryCount;
+
+  if(hMaxima.size() < 1) {
+    return 0;
+  }
+
+  double mark = startStage(ctx);
+  const uint32_t* mapping = &ctx.sparseMapping[0];
+  #pragma omp parallel for
+  for(int y = 0; y < imgIn.rows; y++) {
+    int* row = (int*)(imgOut.data) + y*imgIn.cols;
+    const uint64_t* codes = &ctx.wideCodes[(size_t)y*imgIn.cols];
+    for(int x = 0; x < imgIn.cols; x++)
+      row[x] = mapping[histogram.find(codes[x])];
+  }
+  lapStage(ctx, ctx.stageTimes.map, mark);
+  return hMaxima.size();
+}
 
 // Returns the number of Hamming-space k-maxima. Arguments are an
 // input image, the output image, a set of splitting planes, a value
@@ -302,10 +863,13 @@ vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima);
 // retries. Available retries are used when heuristics suggest that
 // the provided splitting planes have not produced a "good"
 // partitioning of the image.
-int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
-                 vector<float>& planes,
-                 uint32_t hammingK,
-                 int maxRetries) {
+static int hashWithRetries(SegmentationContext& ctx,
+                           const cv::Mat& imgIn, cv::Mat& imgOut,
+                           vector<float>& planes,
+                           uint32_t hammingK,
+                           int maxRetries,
+                           int& attempts) {
+  attempts = 0;
   if(imgOut.rows != imgIn.rows ||
      imgOut.cols != imgIn.cols ||
      imgOut.type() != CV_32S)
@@ -313,35 +877,14 @@ int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
 
   int numChannels = imgIn.channels();
   int numPlanes = planes.size() / numChannels;
-  vector<float> minimums(numPlanes);
-  vector<float> maximums(numPlanes);
-
-  static int lastFrameRows = 0;
-  static int lastFrameCols = 0;
-  static int lastFrameNumPlanes = 0;
-  static float* projections = 0L;
-  static vector<uint32_t> bins;
-  static uint32_t* binMapping = 0L;
-  static float* binColors = 0L;
-
-  if(imgIn.rows != lastFrameRows ||
-     imgIn.cols != lastFrameCols ||
-     numPlanes != lastFrameNumPlanes) {
-    lastFrameRows = imgIn.rows;
-    lastFrameCols = imgIn.cols;
-    lastFrameNumPlanes = numPlanes;
-    
-    if(projections) free(projections);
-    projections = (float*)malloc(sizeof(float)*imgIn.rows*imgIn.cols*numPlanes);
-
-    bins.clear();
-    bins.resize(1 << numPlanes, 0);
-    if(binMapping) free(binMapping);
-    binMapping = (uint32_t*)malloc(sizeof(uint32_t)*bins.size());
+  if(numPlanes > ctx.maxDensePlanes)
+    return hammingHashSparse(ctx, imgIn, imgOut, planes, hammingK,
+                             maxRetries, attempts);
 
-    if(binColors) free(binColors);
-    binColors = (float*)malloc(sizeof(float)*3*bins.size());
-  }
+  ctx.reserve(imgIn.rows, imgIn.cols, numPlanes);
+  vector<uint32_t>& bins = ctx.bins;
+  uint32_t* binMapping = ctx.binMapping;
+  float* binColors = ctx.binColors;
   
   vector<uint32_t> hMaxima;
   int retryCount = 0;
@@ -350,22 +893,17 @@ int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
     retryCount++;
     bool hasBadPlane = false;
 
-    memset(binColors, 0, sizeof(float)*3*bins.size());
-    memset(&bins[0], 0, sizeof(uint32_t)*bins.size());
-
-    // Project pixels onto the given planes. This is effected by
-    // considering the sign of the dot product between each pixel and
-    // the vector associated with each plane.
-    projectPixels(imgIn, planes, projections, minimums, maximums);
-
-    // Generate a binary encoding of each projection, store the codes in imgOut.
-    encodeProjections(minimums, maximums, projections, imgIn, 
-                      imgOut, binColors, bins);
+    // Project pixels onto the given planes, then generate a binary
+    // encoding of each projection and store the codes in imgOut.
+    projectAndEncode(ctx, imgIn, imgOut, planes);
 
     // Compute local maxima in Hamming space
-    hammingMaxima(bins, numPlanes, hammingK, hMaxima);
+    double mark = startStage(ctx);
+    hammingMaxima(bins, ctx.activeBins, numPlanes, hammingK,
+                  ctx.neighborhood, hMaxima);
+    lapStage(ctx, ctx.stageTimes.maxima, mark);
     if(hMaxima.size() < 1) {
-      randomizeAllPlanes(numPlanes, numChannels, &planes[0]);
+      randomizeAllPlanes(numPlanes, numChannels, &planes[0], ctx.rng);
       goto KEEP_TRYING;
     }
 
@@ -376,7 +914,7 @@ int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
       for(int i = 0; i < numPlanes; i++) {
         if(power[i] < 0.0001) {
           hasBadPlane = true;
-          randomUnitVector(numChannels, &planes[i*numChannels]);
+          randomUnitVector(numChannels, &planes[i*numChannels], ctx.rng);
         }
       }
     }
@@ -389,36 +927,329 @@ int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
       for(int i = 0; i < numPlanes; i++) {
         if(correlations[i] > 0.9f) {
           hasBadPlane = true;
-          randomUnitVector(numChannels, &planes[i*numChannels]);
+          randomUnitVector(numChannels, &planes[i*numChannels], ctx.rng);
         }
       }
     }
     if(hasBadPlane && retryCount < maxRetries) goto KEEP_TRYING;
 
     // Map non-maxima in Hamming space to nearest maximum.
-    mapToMaxima(bins, hMaxima, binColors, binMapping);
+    mark = startStage(ctx);
+    mapToMaxima(bins, ctx.activeBins, hMaxima, binColors, binMapping,
+                ctx.neighborhood, ctx.search);
+    lapStage(ctx, ctx.stageTimes.map, mark);
 
     break;
   KEEP_TRYING:
     if(retryCount < maxRetries) {
-      memset((uint32_t*)&bins[0], 0, sizeof(uint32_t)*bins.size());
       hMaxima.clear();
     } else {
-      mapToMaxima(bins, hMaxima, binColors, binMapping);
+      double mark = startStage(ctx);
+      mapToMaxima(bins, ctx.activeBins, hMaxima, binColors, binMapping,
+                  ctx.neighborhood, ctx.search);
+      lapStage(ctx, ctx.stageTimes.map, mark);
     }
     continue;
   }
+  attempts = retryCount;
 
   if(hMaxima.size() < 1) {
     return 0;
   }
 
   // Apply the mapping to our coded image
+  double mark = startStage(ctx);
   for(int y = 0; y < imgIn.rows; y++) {
     int* row = (int*)(imgOut.data) + y*imgIn.cols;
     for(int x = 0; x < imgIn.cols; x++, row++) {
       *row = binMapping[*row];
     }
   }
+  lapStage(ctx, ctx.stageTimes.map, mark);
   return hMaxima.size();
 }
+
+int hammingHash(SegmentationContext& ctx,
+                const cv::Mat& imgIn, cv::Mat& imgOut,
+                vector<float>& planes,
+                uint32_t hammingK,
+                int maxRetries) {
+  CallTrace trace(TRACE_HAMMING_HASH);
+  int attempts;
+  if(!trace.active)
+    return hashWithRetries(ctx, imgIn, imgOut, planes, hammingK,
+                           maxRetries, attempts);
+
+  // Time the stages for the record, leaving the caller's own totals
+  // as they were unless it asked for them too.
+  bool timeStages = ctx.timeStages;
+  HashStageTimes before = ctx.stageTimes;
+  size_t bytesBefore = ctx.allocatedBytes();
+  ctx.timeStages = true;
+  int numMaxima = hashWithRetries(ctx, imgIn, imgOut, planes, hammingK,
+                                  maxRetries, attempts);
+  ctx.timeStages = timeStages;
+
+  CallRecord& r = trace.record;
+  r.projectMs = (ctx.stageTimes.project - before.project) * 1000.0;
+  r.encodeMs = (ctx.stageTimes.encode - before.encode) * 1000.0;
+  r.maximaMs = (ctx.stageTimes.maxima - before.maxima) * 1000.0;
+  r.mapMs = (ctx.stageTimes.map - before.map) * 1000.0;
+  if(!timeStages) ctx.stageTimes = before;
+  r.attempts = attempts;
+  r.count = numMaxima;
+  size_t bytesAfter = ctx.allocatedBytes();
+  r.bytesAllocated = bytesAfter > bytesBefore ? bytesAfter - bytesBefore : 0;
+  return numMaxima;
+}
+
+int hammingHash(const cv::Mat& imgIn, cv::Mat& imgOut,
+                vector<float>& planes,
+                uint32_t hammingK,
+                int maxRetries) {
+  static SegmentationContext sharedContext;
+  return hammingHash(sharedContext, imgIn, imgOut, planes, hammingK, maxRetries);
+}
+
+SegmentationSession::SegmentationSession(const vector<float>& planes,
+                                         uint32_t hammingK,
+                                         int maxRetries)
+  : planes(planes), hammingK(hammingK), maxRetries(maxRetries),
+    maxHistogramChange(0.1f), keyFrameInterval(60),
+    lastFrameWarm(false), lastHistogramChange(1.0f),
+    hasKeyFrame(false), framesSinceKey(0), keyStamp(0),
+    keyRows(0), keyCols(0), keyType(0) {}
+
+SegmentationSession::SegmentationSession(int numPlanes, int numChannels,
+                                         uint32_t hammingK,
+                                         int maxRetries,
+                                         uint64_t seed, uint64_t stream)
+  : hammingK(hammingK), maxRetries(maxRetries),
+    maxHistogramChange(0.1f), keyFrameInterval(60),
+    lastFrameWarm(false), lastHistogramChange(1.0f),
+    hasKeyFrame(false), framesSinceKey(0), keyStamp(0),
+    keyRows(0), keyCols(0), keyType(0) {
+  ctx.rng.seed(seed, stream);
+  planes = makeRandomPlanes(numPlanes, numChannels, ctx.rng);
+}
+
+// Record what later frames are compared against and reuse from the
+// key frame just hashed into [ctx].
+void SegmentationSession::rememberKeyFrame(const cv::Mat& imgIn) {
+  const vector<uint32_t>& bins = ctx.bins;
+  const vector<uint32_t>& active = ctx.activeBins;
+  keyRows = imgIn.rows;
+  keyCols = imgIn.cols;
+  keyType = imgIn.type();
+  keyStamp++;
+  framesSinceKey = 0;
+  hasKeyFrame = true;
+
+  // The codes are resolved to maxima by the time hammingHash returns,
+  // and each maximum's bin has absorbed the bins mapped to it. Undo
+  // that to recover the frame's own histogram, and put it back in
+  // [ctx.bins] so that hashBlocks can patch it.
+  if(keyBins.size() != bins.size()) {
+    keyBins.assign(bins.size(), 0);
+    mappedStamp.assign(bins.size(), 0);
+  }
+  else {
+    for(int i = 0; i < keyActive.size(); i++) keyBins[keyActive[i]] = 0;
+  }
+  keyActive = active;
+  maxima.clear();
+  for(int i = 0; i < active.size(); i++) {
+    uint32_t code = active[i];
+    keyBins[code] += bins[code];
+    uint32_t center = ctx.binMapping[code];
+    if(center == code) maxima.push_back(code);
+    else keyBins[center] -= bins[code];
+    mappedStamp[code] = keyStamp;
+  }
+  for(int i = 0; i < active.size(); i++)
+    ctx.bins[active[i]] = keyBins[active[i]];
+
+  // Maxima colors were normalized by mapToMaxima.
+  maximaColors.resize(maxima.size()*3);
+  for(int i = 0; i < maxima.size(); i++)
+    memcpy(&maximaColors[i*3], &ctx.binColors[maxima[i]*3], sizeof(float)*3);
+}
+
+// Fraction of the frame's pixels whose code count differs from the key
+// frame's, i.e. half the L1 distance between the two histograms over
+// the number of pixels.
+float SegmentationSession::histogramChange(size_t numPixels) const {
+  const vector<uint32_t>& bins = ctx.bins;
+  uint64_t change = 0;
+  for(int i = 0; i < ctx.activeBins.size(); i++) {
+    uint32_t code = ctx.activeBins[i];
+    change += bins[code] > keyBins[code] ? bins[code] - keyBins[code]
+                                         : keyBins[code] - bins[code];
+  }
+  for(int i = 0; i < keyActive.size(); i++)
+    if(bins[keyActive[i]] == 0) change += keyBins[keyActive[i]];
+  return (float)change / (2.0f * (float)numPixels);
+}
+
+// Codes seen before keep the maximum they were mapped to. Any of the
+// [n] [codes] new since the key frame are mapped to their nearest key
+// frame maximum.
+void SegmentationSession::mapUnseenCodes(const uint32_t* codes, size_t n,
+                                         int numPlanes) {
+  vector<uint64_t>& maximaBits = ctx.search.maximaBits;
+  bool searching = false;
+  for(size_t i = 0; i < n; i++) {
+    uint32_t code = codes[i];
+    if(mappedStamp[code] == keyStamp) continue;
+    if(!searching) {
+      maximaBits.resize((ctx.bins.size() + 63) / 64, 0);
+      for(int m = 0; m < maxima.size(); m++) {
+        maximaBits[maxima[m] >> 6] |= (uint64_t)1 << (maxima[m] & 63);
+        memcpy(&ctx.binColors[maxima[m]*3], &maximaColors[m*3],
+               sizeof(float)*3);
+      }
+      searching = true;
+    }
+    ctx.binMapping[code] = nearestMaximum(code, numPlanes, ctx.binColors,
+                                          maximaBits, ctx.neighborhood);
+    mappedStamp[code] = keyStamp;
+  }
+  if(searching)
+    for(int m = 0; m < maxima.size(); m++) maximaBits[maxima[m] >> 6] = 0;
+}
+
+void SegmentationSession::reset() {
+  hasKeyFrame = false;
+}
+
+int SegmentationSession::hash(const cv::Mat& imgIn, cv::Mat& imgOut) {
+  int numChannels = imgIn.channels();
+  int numPlanes = planes.size() / numChannels;
+  bool warm = hasKeyFrame && framesSinceKey + 1 < keyFrameInterval &&
+              imgIn.rows == keyRows && imgIn.cols == keyCols &&
+              imgIn.type() == keyType && numPlanes <= ctx.maxDensePlanes;
+
+  if(warm) {
+    // Encode against the key frame's planes and midpoints, and only go
+    // on if the histogram has barely moved.
+    if(imgOut.rows != imgIn.rows ||
+       imgOut.cols != imgIn.cols ||
+       imgOut.type() != CV_32S)
+      imgOut.create(imgIn.rows, imgIn.cols, CV_32S);
+    encodeRows(ctx, pixelEncoder(ctx, imgIn), imgIn, imgOut);
+    lastHistogramChange = histogramChange((size_t)imgIn.rows*imgIn.cols);
+    warm = lastHistogramChange <= maxHistogramChange;
+  }
+
+  lastFrameWarm = warm;
+  if(!warm) {
+    int numMaxima = hammingHash(ctx, imgIn, imgOut, planes, hammingK,
+                                maxRetries);
+    hasKeyFrame = false;
+    if(numMaxima && numPlanes <= ctx.maxDensePlanes) {
+      rememberKeyFrame(imgIn);
+      lastHistogramChange = 0.0f;
+    }
+    return numMaxima;
+  }
+  framesSinceKey++;
+
+  mapUnseenCodes(ctx.activeBins.empty() ? NULL : &ctx.activeBins[0],
+                 ctx.activeBins.size(), numPlanes);
+
+  const uint32_t* binMapping = ctx.binMapping;
+  #pragma omp parallel for
+  for(int y = 0; y < imgIn.rows; y++) {
+    int* row = (int*)(imgOut.data) + y*imgIn.cols;
+    for(int x = 0; x < imgIn.cols; x++) row[x] = binMapping[row[x]];
+  }
+  return maxima.size();
+}
+
+bool SegmentationSession::hashBlocks(const cv::Mat& prevIn,
+                                     const cv::Mat& imgIn, cv::Mat& imgOut,
+                                     const vector<cv::Rect>& blocks) {
+  if(!hasKeyFrame || framesSinceKey + 1 >= keyFrameInterval ||
+     imgIn.rows != keyRows || imgIn.cols != keyCols ||
+     imgIn.type() != keyType || prevIn.rows != imgIn.rows ||
+     prevIn.cols != imgIn.cols || prevIn.type() != imgIn.type() ||
+     imgOut.rows != imgIn.rows || imgOut.cols != imgIn.cols ||
+     imgOut.type() != CV_32S)
+    return false;
+
+  int numChannels = imgIn.channels();
+  int numPlanes = planes.size() / numChannels;
+  RowEncoder encodeNew = pixelEncoder(ctx, imgIn);
+  RowEncoder encodeOld = pixelEncoder(ctx, prevIn);
+
+  // Encode the blocks as they were and as they are now.
+  vector<size_t> blockStart(blocks.size() + 1, 0);
+  for(int b = 0; b < blocks.size(); b++)
+    blockStart[b + 1] = blockStart[b] + (size_t)blocks[b].width*blocks[b].height;
+  vector<uint32_t> oldCodes(blockStart.back()), newCodes(blockStart.back());
+  #pragma omp parallel for schedule(dynamic)
+  for(int b = 0; b < blocks.size(); b++) {
+    const cv::Rect& r = blocks[b];
+    for(int y = 0; y < r.height; y++) {
+      size_t offset = blockStart[b] + (size_t)y*r.width;
+      encodeOld.encodeSpan(r.y + y, r.x, r.width, &oldCodes[offset]);
+      encodeNew.encodeSpan(r.y + y, r.x, r.width, &newCodes[offset]);
+    }
+  }
+
+  // Move each pixel from its old bin to its new one.
+  vector<uint32_t>& bins = ctx.bins;
+  float* binColors = ctx.binColors;
+  int summed = numChannels < 3 ? numChannels : 3;
+  bool added = false;
+  for(int b = 0; b < blocks.size(); b++) {
+    const cv::Rect& r = blocks[b];
+    for(int y = 0; y < r.height; y++) {
+      const uint8_t* oldColor = prevIn.ptr(r.y + y) + r.x*numChannels;
+      const uint8_t* newColor = imgIn.ptr(r.y + y) + r.x*numChannels;
+      const uint32_t* oldRow = &oldCodes[blockStart[b] + (size_t)y*r.width];
+      const uint32_t* newRow = &newCodes[blockStart[b] + (size_t)y*r.width];
+      for(int x = 0; x < r.width; x++) {
+        uint32_t oldCode = oldRow[x], newCode = newRow[x];
+        if(oldCode != newCode) {
+          bins[oldCode]--;
+          if(bins[newCode]++ == 0) {
+            memset(&binColors[newCode*3], 0, sizeof(float)*3);
+            ctx.activeBins.push_back(newCode);
+            added = true;
+          }
+        }
+        for(int d = 0; d < summed; d++) {
+          binColors[oldCode*3 + d] -= oldColor[x*numChannels + d];
+          binColors[newCode*3 + d] += newColor[x*numChannels + d];
+        }
+      }
+    }
+  }
+
+  // Keep [ctx.activeBins] to the occupied codes, in ascending order.
+  size_t numActive = 0;
+  for(size_t i = 0; i < ctx.activeBins.size(); i++)
+    if(bins[ctx.activeBins[i]]) ctx.activeBins[numActive++] = ctx.activeBins[i];
+  ctx.activeBins.resize(numActive);
+  if(added) sort(ctx.activeBins.begin(), ctx.activeBins.end());
+
+  lastHistogramChange = histogramChange((size_t)imgIn.rows*imgIn.cols);
+  if(lastHistogramChange > maxHistogramChange) return false;
+  lastFrameWarm = true;
+  framesSinceKey++;
+
+  mapUnseenCodes(newCodes.empty() ? NULL : &newCodes[0], newCodes.size(),
+                 numPlanes);
+  const uint32_t* binMapping = ctx.binMapping;
+  #pragma omp parallel for schedule(dynamic)
+  for(int b = 0; b < blocks.size(); b++) {
+    const cv::Rect& r = blocks[b];
+    for(int y = 0; y < r.height; y++) {
+      int* row = (int*)imgOut.ptr(r.y + y) + r.x;
+      const uint32_t* codes = &newCodes[blockStart[b] + (size_t)y*r.width];
+      for(int x = 0; x < r.width; x++) row[x] = binMapping[codes[x]];
+    }
+  }
+  return true;
+}
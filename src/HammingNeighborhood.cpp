@@ -0,0 +1,46 @@
+#include <algorithm>
+#include "HammingNeighborhood.h"
+
+using namespace std;
+
+void HammingNeighborhood::generate(int bits, int k) {
+  if(k > bits) k = bits;
+  if(bits == numBits && k <= radius) return;
+
+  if(bits != numBits) {
+    // Put away the current tables and bring back this length's.
+    if(stored.size() <= (size_t)max(bits, numBits))
+      stored.resize(max(bits, numBits) + 1);
+    Tables& current = stored[numBits];
+    current.radius = radius;
+    current.counts.swap(counts);
+    current.masks.swap(masks);
+    Tables& next = stored[bits];
+    radius = next.radius;
+    counts.swap(next.counts);
+    masks.swap(next.masks);
+    numBits = bits;
+  }
+
+  uint64_t limit = (uint64_t)1 << bits;
+  for(int d = radius + 1; d <= k; d++) {
+    // Visit every d-bit number below 2^bits in ascending order (by
+    // computing the next number with the same number of set bits),
+    // then reverse them.
+    size_t start = masks.size();
+    for(uint64_t v = ((uint64_t)1 << d) - 1; v < limit; ) {
+      masks.push_back((uint32_t)v);
+      uint64_t t = v | (v - 1);
+      v = (t + 1) | (((~t & (t + 1)) - 1) >> (__builtin_ctzll(v) + 1));
+    }
+    reverse(masks.begin() + start, masks.end());
+    counts.push_back(masks.size() - start);
+  }
+  radius = max(radius, k);
+}
+
+uint32_t HammingNeighborhood::countWithin(int k) const {
+  uint32_t n = 0;
+  for(int d = 0; d < k && d < radius; d++) n += counts[d];
+  return n;
+}
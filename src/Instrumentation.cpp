@@ -0,0 +1,192 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#include "Instrumentation.h"
+
+using namespace std;
+
+int instrumentationFlag = 0;
+
+// Shared state, guarded by [lock]. The lock is only taken by traced
+// calls, so never while instrumentation is off.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static vector<CallRecord> ring;
+static size_t ringHead = 0, ringSize = 0;
+static uint64_t dropped = 0;
+static InstrumentationCallback callback = NULL;
+static void* callbackData = NULL;
+
+static bool countersWanted = false;
+static double epoch = 0.0;
+static uint64_t nextSequence = 0;
+static int nextThread = 0;
+
+// Per-thread state: the thread's number, and its counter file
+// descriptors (-1 if they could not be opened). Counters are opened on
+// a thread's first traced call.
+static __thread int threadNumber = -1;
+static __thread int counterFds[2] = { -1, -1 };
+static __thread bool countersOpened = false;
+
+static double monotonicSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+#ifdef __linux__
+static int openCounter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  // User space only, which unprivileged processes are usually allowed.
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void openCounters() {
+  countersOpened = true;
+#ifdef __linux__
+  counterFds[0] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  counterFds[1] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+static int64_t readCounter(int fd) {
+  if(fd < 0) return -1;
+  uint64_t value;
+  if(read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+  return value;
+}
+
+void enableInstrumentation(size_t ringCapacity, bool hardwareCounters) {
+  pthread_mutex_lock(&lock);
+  ring.assign(ringCapacity > 0 ? ringCapacity : 1, CallRecord());
+  ringHead = ringSize = 0;
+  dropped = 0;
+  nextSequence = 0;
+  countersWanted = hardwareCounters;
+  epoch = monotonicSeconds();
+  __atomic_store_n(&instrumentationFlag, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&lock);
+}
+
+void disableInstrumentation() {
+  __atomic_store_n(&instrumentationFlag, 0, __ATOMIC_RELEASE);
+}
+
+void setInstrumentationCallback(InstrumentationCallback cb, void* userData) {
+  pthread_mutex_lock(&lock);
+  callback = cb;
+  callbackData = userData;
+  pthread_mutex_unlock(&lock);
+}
+
+size_t drainInstrumentation(vector<CallRecord>& records) {
+  pthread_mutex_lock(&lock);
+  size_t n = ringSize;
+  for(size_t i = 0; i < n; i++)
+    records.push_back(ring[(ringHead + ring.size() - n + i) % ring.size()]);
+  ringSize = 0;
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+uint64_t instrumentationDropped() {
+  pthread_mutex_lock(&lock);
+  uint64_t n = dropped;
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+void CallTrace::begin(TracedFunction function) {
+  memset(&record, 0, sizeof(record));
+  record.function = function;
+  record.instructions = record.cacheMisses = -1;
+
+  pthread_mutex_lock(&lock);
+  record.sequence = nextSequence++;
+  if(threadNumber < 0) threadNumber = nextThread++;
+  bool counters = countersWanted;
+  double since = epoch;
+  pthread_mutex_unlock(&lock);
+  record.thread = threadNumber;
+
+  if(counters && !countersOpened) openCounters();
+  startInstructions = counters ? readCounter(counterFds[0]) : -1;
+  startCacheMisses = counters ? readCounter(counterFds[1]) : -1;
+  record.start = monotonicSeconds() - since;
+}
+
+void CallTrace::end() {
+  double stop = monotonicSeconds();
+  if(startInstructions >= 0) {
+    int64_t now = readCounter(counterFds[0]);
+    if(now >= 0) record.instructions = now - startInstructions;
+  }
+  if(startCacheMisses >= 0) {
+    int64_t now = readCounter(counterFds[1]);
+    if(now >= 0) record.cacheMisses = now - startCacheMisses;
+  }
+
+  pthread_mutex_lock(&lock);
+  record.durationMs = (stop - epoch - record.start) * 1000.0;
+  if(!ring.empty()) {
+    if(ringSize == ring.size()) dropped++;
+    else ringSize++;
+    ring[ringHead] = record;
+    ringHead = (ringHead + 1) % ring.size();
+  }
+  InstrumentationCallback cb = callback;
+  void* data = callbackData;
+  pthread_mutex_unlock(&lock);
+  if(cb) cb(record, data);
+}
+
+static const char* functionNames[] = {
+  "hammingHash", "findComponents", "simplify"
+};
+
+void writeRecordsJSON(FILE* out, const vector<CallRecord>& records) {
+  fprintf(out, "[");
+  for(size_t i = 0; i < records.size(); i++) {
+    const CallRecord& r = records[i];
+    fprintf(out, "%s\n  {\"function\": \"%s\", \"sequence\": %llu, "
+            "\"thread\": %d, \"start\": %.6f, \"duration_ms\": %.4f, "
+            "\"project_ms\": %.4f, \"encode_ms\": %.4f, "
+            "\"maxima_ms\": %.4f, \"map_ms\": %.4f, \"attempts\": %d, "
+            "\"count\": %lld, \"bytes_allocated\": %llu, "
+            "\"instructions\": %lld, \"cache_misses\": %lld}",
+            i ? "," : "", functionNames[r.function],
+            (unsigned long long)r.sequence, r.thread, r.start, r.durationMs,
+            r.projectMs, r.encodeMs, r.maximaMs, r.mapMs, r.attempts,
+            (long long)r.count, (unsigned long long)r.bytesAllocated,
+            (long long)r.instructions, (long long)r.cacheMisses);
+  }
+  fprintf(out, "\n]\n");
+}
+
+void writeRecordsCSV(FILE* out, const vector<CallRecord>& records) {
+  fprintf(out, "function,sequence,thread,start,duration_ms,project_ms,"
+          "encode_ms,maxima_ms,map_ms,attempts,count,bytes_allocated,"
+          "instructions,cache_misses\n");
+  for(size_t i = 0; i < records.size(); i++) {
+    const CallRecord& r = records[i];
+    fprintf(out, "%s,%llu,%d,%.6f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%lld,%llu,"
+            "%lld,%lld\n",
+            functionNames[r.function], (unsigned long long)r.sequence,
+            r.thread, r.start, r.durationMs, r.projectMs, r.encodeMs,
+            r.maximaMs, r.mapMs, r.attempts, (long long)r.count,
+            (unsigned long long)r.bytesAllocated,
+            (long long)r.instructions, (long long)r.cacheMisses);
+  }
+}
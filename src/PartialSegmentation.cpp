@@ -0,0 +1,212 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include "PartialSegmentation.h"
+#include "Connected.h"
+
+using namespace std;
+
+int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes);
+
+static const uint32_t NO_LABEL = 0xffffffff;
+
+PartialSegmenter::PartialSegmenter(SegmentationSession& session)
+  : blockSize(32), changeThreshold(4.0f), maxDirtyFraction(0.5f),
+    border(8), lastDirtyBlocks(0), lastFrameFull(true),
+    session(session), nextLabel(0) {
+}
+
+int PartialSegmenter::segmentFull(const cv::Mat& imgIn,
+                                  const cv::Mat& imgColor, cv::Mat& labels) {
+  lastFrameFull = true;
+  if(!session.hash(imgIn, codes)) {
+    prevFrame.release();
+    return 0;
+  }
+  labelImg = codes.clone();
+  int numComponents = findComponents(labelImg);
+  simplify(imgColor, labelImg, numComponents);
+  nextLabel = numComponents;
+  prevFrame = imgIn.clone();
+  labelImg.copyTo(labels);
+  return nextLabel;
+}
+
+// Give local label [local] the label [outside] of a pixel just outside
+// its window, if it has none yet and both pixels have the same code.
+static inline void adoptAcross(uint32_t local, uint32_t insideCode,
+                               uint32_t outsideCode, uint32_t outside,
+                               vector<uint32_t>& adopted) {
+  if(insideCode == outsideCode && adopted[local] == NO_LABEL)
+    adopted[local] = outside;
+}
+
+// Find and simplify the components of [window] again, and stitch them
+// to the labels around it.
+void PartialSegmenter::resegmentWindow(const cv::Mat& imgColor,
+                                       const cv::Rect& window) {
+  cv::Mat local = codes(window).clone();
+  int numComponents = findComponents(local);
+  simplify(imgColor(window), local, numComponents);
+
+  int x0 = window.x, x1 = window.x + window.width;
+  int y0 = window.y, y1 = window.y + window.height;
+  vector<uint32_t> adopted(numComponents, NO_LABEL);
+  if(y0 > 0) {
+    const uint32_t* in = (uint32_t*)local.ptr(0);
+    const uint32_t* inCode = (uint32_t*)codes.ptr(y0) + x0;
+    const uint32_t* outCode = (uint32_t*)codes.ptr(y0 - 1) + x0;
+    const uint32_t* out = (uint32_t*)labelImg.ptr(y0 - 1) + x0;
+    for(int x = 0; x < window.width; x++)
+      adoptAcross(in[x], inCode[x], outCode[x], out[x], adopted);
+  }
+  if(y1 < codes.rows) {
+    const uint32_t* in = (uint32_t*)local.ptr(window.height - 1);
+    const uint32_t* inCode = (uint32_t*)codes.ptr(y1 - 1) + x0;
+    const uint32_t* outCode = (uint32_t*)codes.ptr(y1) + x0;
+    const uint32_t* out = (uint32_t*)labelImg.ptr(y1) + x0;
+    for(int x = 0; x < window.width; x++)
+      adoptAcross(in[x], inCode[x], outCode[x], out[x], adopted);
+  }
+  for(int y = 0; y < window.height; y++) {
+    const uint32_t* in = (uint32_t*)local.ptr(y);
+    const uint32_t* rowCodes = (uint32_t*)codes.ptr(y0 + y);
+    const uint32_t* rowLabels = (uint32_t*)labelImg.ptr(y0 + y);
+    if(x0 > 0)
+      adoptAcross(in[0], rowCodes[x0], rowCodes[x0 - 1], rowLabels[x0 - 1],
+                  adopted);
+    if(x1 < codes.cols)
+      adoptAcross(in[window.width - 1], rowCodes[x1 - 1], rowCodes[x1],
+                  rowLabels[x1], adopted);
+  }
+
+  // Regions that continue none of their surroundings are new.
+  for(int y = 0; y < window.height; y++) {
+    const uint32_t* in = (uint32_t*)local.ptr(y);
+    uint32_t* row = (uint32_t*)labelImg.ptr(y0 + y) + x0;
+    for(int x = 0; x < window.width; x++) {
+      uint32_t& label = adopted[in[x]];
+      if(label == NO_LABEL) label = nextLabel++;
+      row[x] = label;
+    }
+  }
+}
+
+static inline bool overlaps(const cv::Rect& a, const cv::Rect& b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width &&
+         a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+int PartialSegmenter::segment(const cv::Mat& imgIn, const cv::Mat& imgColor,
+                              cv::Mat& labels) {
+  if(prevFrame.empty() || imgIn.rows != prevFrame.rows ||
+     imgIn.cols != prevFrame.cols || imgIn.type() != prevFrame.type()) {
+    lastDirtyBlocks = 0;
+    return segmentFull(imgIn, imgColor, labels);
+  }
+
+  // Find the blocks that changed since the last frame.
+  int gridCols = (imgIn.cols + blockSize - 1) / blockSize;
+  int gridRows = (imgIn.rows + blockSize - 1) / blockSize;
+  int rowBytes = imgIn.cols * imgIn.channels();
+  int blockBytes = blockSize * imgIn.channels();
+  vector<uint8_t> dirty(gridRows*gridCols, 0);
+  #pragma omp parallel for schedule(dynamic)
+  for(int by = 0; by < gridRows; by++) {
+    int top = by*blockSize, bottom = min(top + blockSize, imgIn.rows);
+    vector<uint64_t> sums(gridCols, 0);
+    for(int y = top; y < bottom; y++) {
+      const uint8_t* a = imgIn.ptr(y);
+      const uint8_t* b = prevFrame.ptr(y);
+      for(int bx = 0; bx < gridCols; bx++) {
+        int end = min((bx + 1)*blockBytes, rowBytes);
+        uint32_t sum = 0;
+        for(int i = bx*blockBytes; i < end; i++)
+          sum += abs((int)a[i] - (int)b[i]);
+        sums[bx] += sum;
+      }
+    }
+    for(int bx = 0; bx < gridCols; bx++) {
+      int width = min(blockSize, imgIn.cols - bx*blockSize);
+      double samples = (double)width * (bottom - top) * imgIn.channels();
+      dirty[by*gridCols + bx] = sums[bx] > changeThreshold * samples;
+    }
+  }
+
+  vector<cv::Rect> blocks;
+  for(int by = 0; by < gridRows; by++)
+    for(int bx = 0; bx < gridCols; bx++)
+      if(dirty[by*gridCols + bx])
+        blocks.push_back(cv::Rect(bx*blockSize, by*blockSize,
+                                  min(blockSize, imgIn.cols - bx*blockSize),
+                                  min(blockSize, imgIn.rows - by*blockSize)));
+  lastDirtyBlocks = blocks.size();
+  lastFrameFull = false;
+  if(blocks.empty()) {
+    labelImg.copyTo(labels);
+    return nextLabel;
+  }
+  if(blocks.size() > maxDirtyFraction * gridRows * gridCols ||
+     !session.hashBlocks(prevFrame, imgIn, codes, blocks))
+    return segmentFull(imgIn, imgColor, labels);
+  for(size_t b = 0; b < blocks.size(); b++) {
+    cv::Mat prevBlock = prevFrame(blocks[b]);
+    imgIn(blocks[b]).copyTo(prevBlock);
+  }
+
+  // Gather 8-connected groups of changed blocks into windows: each
+  // group's bounding box and a border around it. Windows that overlap
+  // are joined, so that every pixel is segmented again at most once.
+  vector<cv::Rect> windows;
+  vector<int> stack;
+  for(int start = 0; start < gridRows*gridCols; start++) {
+    if(dirty[start] != 1) continue;
+    int minX = gridCols, maxX = -1, minY = gridRows, maxY = -1;
+    dirty[start] = 2;
+    stack.push_back(start);
+    while(!stack.empty()) {
+      int cell = stack.back();
+      stack.pop_back();
+      int bx = cell % gridCols, by = cell / gridCols;
+      minX = min(minX, bx); maxX = max(maxX, bx);
+      minY = min(minY, by); maxY = max(maxY, by);
+      for(int ny = max(by - 1, 0); ny <= min(by + 1, gridRows - 1); ny++)
+        for(int nx = max(bx - 1, 0); nx <= min(bx + 1, gridCols - 1); nx++)
+          if(dirty[ny*gridCols + nx] == 1) {
+            dirty[ny*gridCols + nx] = 2;
+            stack.push_back(ny*gridCols + nx);
+          }
+    }
+    int left = max(minX*blockSize - border, 0);
+    int top = max(minY*blockSize - border, 0);
+    int right = min((maxX + 1)*blockSize + border, imgIn.cols);
+    int bottom = min((maxY + 1)*blockSize + border, imgIn.rows);
+    windows.push_back(cv::Rect(left, top, right - left, bottom - top));
+  }
+  bool joined = true;
+  while(joined) {
+    joined = false;
+    for(size_t i = 0; i < windows.size(); i++) {
+      for(size_t j = i + 1; j < windows.size(); ) {
+        if(!overlaps(windows[i], windows[j])) {
+          j++;
+          continue;
+        }
+        cv::Rect& a = windows[i];
+        const cv::Rect& b = windows[j];
+        int left = min(a.x, b.x), top = min(a.y, b.y);
+        int right = max(a.x + a.width, b.x + b.width);
+        int bottom = max(a.y + a.height, b.y + b.height);
+        a = cv::Rect(left, top, right - left, bottom - top);
+        windows.erase(windows.begin() + j);
+        joined = true;
+      }
+    }
+  }
+
+  for(size_t w = 0; w < windows.size(); w++)
+    resegmentWindow(imgColor, windows[w]);
+  labelImg.copyTo(labels);
+  return nextLabel;
+}
@@ -11,8 +11,9 @@ inline T dot(int n, T* x, T* y) {
 
 // Check to see how redundant certain planes are. If one plane
 // perfectly predicts another, then the second should be abandoned.
-vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima) {
-  uint32_t mask = 1;
+template<typename Code>
+static vector<float> planeCorrelationOf(int numPlanes, vector<Code>& maxima) {
+  Code mask = 1;
   int si = maxima.size();
   float* planeVectors = (float*)malloc(sizeof(float)*numPlanes*si);
 
@@ -48,9 +49,11 @@ vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima) {
 // Compute the ratio of maxima distinguished by a particular
 // plane. E.g. if a plane only distinguishes one maximum from the
 // rest, then it gets a value of 1 / numMaxima.
-vector<float> discriminativePower(int numPlanes, vector<uint32_t>& maxima) {
+template<typename Code>
+static vector<float> discriminativePowerOf(int numPlanes,
+                                           vector<Code>& maxima) {
   vector<float> power(numPlanes);
-  uint32_t mask = 1;
+  Code mask = 1;
   int si = maxima.size();
   float s = 1.0f / (float)si;
 
@@ -66,3 +69,21 @@ vector<float> discriminativePower(int numPlanes, vector<uint32_t>& maxima) {
   }
   return power;
 }
+
+// Codes are 32 bits wide with a dense histogram, and 64 bits wide with
+// a sparse one.
+vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima) {
+  return planeCorrelationOf(numPlanes, maxima);
+}
+
+vector<float> planeCorrelation(int numPlanes, vector<uint64_t>& maxima) {
+  return planeCorrelationOf(numPlanes, maxima);
+}
+
+vector<float> discriminativePower(int numPlanes, vector<uint32_t>& maxima) {
+  return discriminativePowerOf(numPlanes, maxima);
+}
+
+vector<float> discriminativePower(int numPlanes, vector<uint64_t>& maxima) {
+  return discriminativePowerOf(numPlanes, maxima);
+}
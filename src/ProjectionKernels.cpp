@@ -0,0 +1,493 @@
+#include <string.h>
+#include <math.h>
+#include "ProjectionKernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+using namespace std;
+
+void PlaneLayout::setPlanes(const vector<float>& planes, int channels) {
+  numChannels = channels;
+  numPlanes = planes.size() / numChannels;
+  paddedPlanes = (numPlanes + 7) & ~7;
+  weights.assign(numChannels*paddedPlanes, 0.0f);
+  for(int plane = 0; plane < numPlanes; plane++)
+    for(int d = 0; d < numChannels; d++)
+      weights[d*paddedPlanes + plane] = planes[plane*numChannels + d];
+  midpoints.assign(paddedPlanes, 0.0f);
+}
+
+void PlaneLayout::setMidpoints(const float* minimums, const float* maximums) {
+  for(int plane = 0; plane < numPlanes; plane++)
+    midpoints[plane] = (maximums[plane]+minimums[plane]) * 0.5f;
+}
+
+// Bits of a code that correspond to real (not padding) planes.
+static inline uint32_t codeMask(int numPlanes) {
+  return numPlanes >= 32 ? 0xffffffff : (1u << numPlanes) - 1;
+}
+
+// Scalar kernels. These are the reference against which the vector
+// kernels are written: every projection is accumulated channel by
+// channel starting from zero.
+
+static void projectRowScalar(const PlaneLayout& layout,
+                             const uint8_t* pixels, int cols,
+                             float* projections,
+                             float* minRow, float* maxRow) {
+  int numChannels = layout.numChannels;
+  int numPlanes = layout.numPlanes;
+  int stride = layout.paddedPlanes;
+  float pixelBuffer[numChannels];
+  for(int x = 0; x < cols; x++) {
+    for(int d = 0; d < numChannels; d++, pixels++)
+      pixelBuffer[d] = (float)(*pixels) - 128.0f;
+
+    for(int plane = 0; plane < numPlanes; plane++) {
+      float sum = 0.0f;
+      const float* w = &layout.weights[plane];
+      for(int d = 0; d < numChannels; d++, w += stride)
+        sum += pixelBuffer[d] * (*w);
+      if(projections) *(projections++) = sum;
+      if(sum > maxRow[plane]) maxRow[plane] = sum;
+      if(sum < minRow[plane]) minRow[plane] = sum;
+    }
+  }
+}
+
+static void encodeRowScalar(const PlaneLayout& layout,
+                            const float* projections, int cols,
+                            uint32_t* codes) {
+  int numPlanes = layout.numPlanes;
+  const float* midpoints = &layout.midpoints[0];
+  for(int x = 0; x < cols; x++) {
+    uint32_t code = 0, mask = 1;
+    for(int plane = 0; plane < numPlanes;
+        plane++, mask *= 2, projections++) {
+      if(*projections > midpoints[plane]) code |= mask;
+    }
+    codes[x] = code;
+  }
+}
+
+static void projectEncodeRowScalar(const PlaneLayout& layout,
+                                   const uint8_t* pixels, int cols,
+                                   uint32_t* codes) {
+  int numChannels = layout.numChannels;
+  int numPlanes = layout.numPlanes;
+  int stride = layout.paddedPlanes;
+  const float* midpoints = &layout.midpoints[0];
+  float pixelBuffer[numChannels];
+  for(int x = 0; x < cols; x++) {
+    for(int d = 0; d < numChannels; d++, pixels++)
+      pixelBuffer[d] = (float)(*pixels) - 128.0f;
+
+    uint32_t code = 0, mask = 1;
+    for(int plane = 0; plane < numPlanes; plane++, mask *= 2) {
+      float sum = 0.0f;
+      const float* w = &layout.weights[plane];
+      for(int d = 0; d < numChannels; d++, w += stride)
+        sum += pixelBuffer[d] * (*w);
+      if(sum > midpoints[plane]) code |= mask;
+    }
+    codes[x] = code;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// SSE kernels work on 4 planes per register. SSE2 is part of the
+// x86-64 baseline, so these need no special target. Extrema are
+// updated with min(sum, old) and max(sum, old), which keep the old
+// value on ties exactly as the scalar comparisons do.
+
+static void projectRowSSE(const PlaneLayout& layout,
+                          const uint8_t* pixels, int cols,
+                          float* projections,
+                          float* minRow, float* maxRow) {
+  int numChannels = layout.numChannels;
+  int numPlanes = layout.numPlanes;
+  int stride = layout.paddedPlanes;
+  int numChunks = (numPlanes + 3) / 4;
+  const float* weights = &layout.weights[0];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    for(int c = 0; c < numChunks; c++) {
+      __m128 acc = _mm_setzero_ps();
+      const float* w = weights + c*4;
+      for(int d = 0; d < numChannels; d++, w += stride) {
+        __m128 p = _mm_set1_ps((float)pixels[d] - 128.0f);
+        acc = _mm_add_ps(acc, _mm_mul_ps(p, _mm_loadu_ps(w)));
+      }
+      _mm_storeu_ps(minRow + c*4, _mm_min_ps(acc, _mm_loadu_ps(minRow + c*4)));
+      _mm_storeu_ps(maxRow + c*4, _mm_max_ps(acc, _mm_loadu_ps(maxRow + c*4)));
+      if(projections) {
+        int valid = numPlanes - c*4;
+        if(valid >= 4) _mm_storeu_ps(projections + c*4, acc);
+        else {
+          float lanes[4];
+          _mm_storeu_ps(lanes, acc);
+          memcpy(projections + c*4, lanes, sizeof(float)*valid);
+        }
+      }
+    }
+    if(projections) projections += numPlanes;
+  }
+}
+
+static void encodeRowSSE(const PlaneLayout& layout,
+                         const float* projections, int cols,
+                         uint32_t* codes) {
+  int numPlanes = layout.numPlanes;
+  int fullChunks = numPlanes / 4;
+  const float* midpoints = &layout.midpoints[0];
+  for(int x = 0; x < cols; x++, projections += numPlanes) {
+    uint32_t code = 0;
+    int c = 0;
+    for(; c < fullChunks; c++) {
+      __m128 gt = _mm_cmpgt_ps(_mm_loadu_ps(projections + c*4),
+                               _mm_loadu_ps(midpoints + c*4));
+      code |= (uint32_t)_mm_movemask_ps(gt) << (c*4);
+    }
+    for(int plane = c*4; plane < numPlanes; plane++)
+      if(projections[plane] > midpoints[plane]) code |= 1u << plane;
+    codes[x] = code;
+  }
+}
+
+static void projectEncodeRowSSE(const PlaneLayout& layout,
+                                const uint8_t* pixels, int cols,
+                                uint32_t* codes) {
+  int numChannels = layout.numChannels;
+  int stride = layout.paddedPlanes;
+  int numChunks = (layout.numPlanes + 3) / 4;
+  uint32_t validBits = codeMask(layout.numPlanes);
+  const float* weights = &layout.weights[0];
+  const float* midpoints = &layout.midpoints[0];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    uint32_t code = 0;
+    for(int c = 0; c < numChunks; c++) {
+      __m128 acc = _mm_setzero_ps();
+      const float* w = weights + c*4;
+      for(int d = 0; d < numChannels; d++, w += stride) {
+        __m128 p = _mm_set1_ps((float)pixels[d] - 128.0f);
+        acc = _mm_add_ps(acc, _mm_mul_ps(p, _mm_loadu_ps(w)));
+      }
+      __m128 gt = _mm_cmpgt_ps(acc, _mm_loadu_ps(midpoints + c*4));
+      code |= (uint32_t)_mm_movemask_ps(gt) << (c*4);
+    }
+    codes[x] = code & validBits;
+  }
+}
+
+// AVX2 kernels work on 8 planes per register, so the common case of
+// up to 8 planes costs one multiply and add per channel per pixel,
+// and a single compare and movemask to produce the code. FMA is
+// deliberately not enabled: fused rounding would change projections
+// relative to the scalar kernels.
+
+// Lane mask selecting the first [valid] of 8 lanes.
+__attribute__((target("avx2")))
+static inline __m256i laneMask(int valid) {
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(valid),
+                            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+__attribute__((target("avx2")))
+static void projectRowAVX2(const PlaneLayout& layout,
+                           const uint8_t* pixels, int cols,
+                           float* projections,
+                           float* minRow, float* maxRow) {
+  int numChannels = layout.numChannels;
+  int numPlanes = layout.numPlanes;
+  int stride = layout.paddedPlanes;
+  int numChunks = stride / 8;
+  int tail = numPlanes - (numChunks - 1)*8;
+  __m256i tailMask = laneMask(tail);
+  const float* weights = &layout.weights[0];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    for(int c = 0; c < numChunks; c++) {
+      __m256 acc = _mm256_setzero_ps();
+      const float* w = weights + c*8;
+      for(int d = 0; d < numChannels; d++, w += stride) {
+        __m256 p = _mm256_set1_ps((float)pixels[d] - 128.0f);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(p, _mm256_loadu_ps(w)));
+      }
+      _mm256_storeu_ps(minRow + c*8,
+                       _mm256_min_ps(acc, _mm256_loadu_ps(minRow + c*8)));
+      _mm256_storeu_ps(maxRow + c*8,
+                       _mm256_max_ps(acc, _mm256_loadu_ps(maxRow + c*8)));
+      if(projections) {
+        if(c < numChunks - 1 || tail == 8)
+          _mm256_storeu_ps(projections + c*8, acc);
+        else
+          _mm256_maskstore_ps(projections + c*8, tailMask, acc);
+      }
+    }
+    if(projections) projections += numPlanes;
+  }
+}
+
+__attribute__((target("avx2")))
+static void encodeRowAVX2(const PlaneLayout& layout,
+                          const float* projections, int cols,
+                          uint32_t* codes) {
+  int numPlanes = layout.numPlanes;
+  int numChunks = layout.paddedPlanes / 8;
+  int tail = numPlanes - (numChunks - 1)*8;
+  __m256i tailMask = laneMask(tail);
+  uint32_t validBits = codeMask(numPlanes);
+  const float* midpoints = &layout.midpoints[0];
+  for(int x = 0; x < cols; x++, projections += numPlanes) {
+    uint32_t code = 0;
+    for(int c = 0; c < numChunks; c++) {
+      __m256 v;
+      if(c < numChunks - 1 || tail == 8)
+        v = _mm256_loadu_ps(projections + c*8);
+      else
+        v = _mm256_maskload_ps(projections + c*8, tailMask);
+      __m256 gt = _mm256_cmp_ps(v, _mm256_loadu_ps(midpoints + c*8),
+                                _CMP_GT_OQ);
+      code |= (uint32_t)_mm256_movemask_ps(gt) << (c*8);
+    }
+    codes[x] = code & validBits;
+  }
+}
+
+__attribute__((target("avx2")))
+static void projectEncodeRowAVX2(const PlaneLayout& layout,
+                                 const uint8_t* pixels, int cols,
+                                 uint32_t* codes) {
+  int numChannels = layout.numChannels;
+  int stride = layout.paddedPlanes;
+  int numChunks = stride / 8;
+  uint32_t validBits = codeMask(layout.numPlanes);
+  const float* weights = &layout.weights[0];
+  const float* midpoints = &layout.midpoints[0];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    uint32_t code = 0;
+    for(int c = 0; c < numChunks; c++) {
+      __m256 acc = _mm256_setzero_ps();
+      const float* w = weights + c*8;
+      for(int d = 0; d < numChannels; d++, w += stride) {
+        __m256 p = _mm256_set1_ps((float)pixels[d] - 128.0f);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(p, _mm256_loadu_ps(w)));
+      }
+      __m256 gt = _mm256_cmp_ps(acc, _mm256_loadu_ps(midpoints + c*8),
+                                _CMP_GT_OQ);
+      code |= (uint32_t)_mm256_movemask_ps(gt) << (c*8);
+    }
+    codes[x] = code & validBits;
+  }
+}
+
+#endif
+
+ProjectionISA detectProjectionISA() {
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return ISA_AVX2;
+  return ISA_SSE;
+#else
+  return ISA_SCALAR;
+#endif
+}
+
+const ProjectionKernels& projectionKernels(ProjectionISA isa) {
+  static const ProjectionISA best = detectProjectionISA();
+  static const ProjectionKernels kernels[] = {
+    { projectRowScalar, encodeRowScalar, projectEncodeRowScalar },
+#ifdef HAVE_X86_KERNELS
+    { projectRowSSE, encodeRowSSE, projectEncodeRowSSE },
+    { projectRowAVX2, encodeRowAVX2, projectEncodeRowAVX2 }
+#endif
+  };
+  return kernels[isa > best ? best : isa];
+}
+
+int ProjectionTable::update(const vector<float>& planes, int channels) {
+  int newNumPlanes = planes.size() / channels;
+
+  // A projection is at most 128 times the L1 norm of its plane (which
+  // is sqrt(channels) for unit vectors), and each table entry adds at
+  // most half a unit of rounding error.
+  float maxNorm = sqrt((float)channels);
+  for(int plane = 0; plane < newNumPlanes; plane++) {
+    float norm = 0.0f;
+    for(int d = 0; d < channels; d++)
+      norm += fabs(planes[plane*channels + d]);
+    if(norm > maxNorm) maxNorm = norm;
+  }
+  float newScale = floor((32767.0f - channels) / (128.0f * maxNorm));
+
+  if(channels != numChannels || newNumPlanes != numPlanes ||
+     newScale != scale) {
+    numChannels = channels;
+    numPlanes = newNumPlanes;
+    paddedPlanes = (numPlanes + 7) & ~7;
+    scale = newScale;
+    entries.assign(numChannels*256*paddedPlanes, 0);
+    midpoints.assign(paddedPlanes, 0);
+    sourcePlanes = planes;
+    for(int plane = 0; plane < numPlanes; plane++) buildPlane(plane);
+    return numPlanes;
+  }
+
+  int rebuilt = 0;
+  for(int plane = 0; plane < numPlanes; plane++) {
+    const float* src = &planes[plane*numChannels];
+    float* dst = &sourcePlanes[plane*numChannels];
+    if(memcmp(src, dst, sizeof(float)*numChannels)) {
+      memcpy(dst, src, sizeof(float)*numChannels);
+      buildPlane(plane);
+      rebuilt++;
+    }
+  }
+  return rebuilt;
+}
+
+void ProjectionTable::buildPlane(int plane) {
+  for(int d = 0; d < numChannels; d++) {
+    float w = sourcePlanes[plane*numChannels + d] * scale;
+    int16_t* entry = &entries[d*256*paddedPlanes + plane];
+    for(int v = 0; v < 256; v++, entry += paddedPlanes)
+      *entry = (int16_t)lrintf(((float)v - 128.0f) * w);
+  }
+}
+
+void ProjectionTable::setMidpoints(const int16_t* minimums,
+                                   const int16_t* maximums) {
+  // For integers, x > (min+max)/2 exactly when x > floor((min+max)/2).
+  for(int plane = 0; plane < numPlanes; plane++)
+    midpoints[plane] = (int16_t)(((int)maximums[plane] + minimums[plane]) >> 1);
+}
+
+void projectRowLUT(const ProjectionTable& table,
+                   const uint8_t* pixels, int cols,
+                   int16_t* projections,
+                   int16_t* minRow, int16_t* maxRow) {
+  int numChannels = table.numChannels;
+  int numPlanes = table.numPlanes;
+  int stride = table.paddedPlanes;
+  const int16_t* entries = &table.entries[0];
+#ifdef HAVE_X86_KERNELS
+  int numChunks = stride / 8;
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    for(int c = 0; c < numChunks; c++) {
+      const int16_t* e = entries + c*8;
+      __m128i acc = _mm_loadu_si128((const __m128i*)(e + pixels[0]*stride));
+      for(int d = 1; d < numChannels; d++) {
+        const __m128i* entry = (const __m128i*)(e + (d*256 + pixels[d])*stride);
+        acc = _mm_add_epi16(acc, _mm_loadu_si128(entry));
+      }
+      __m128i* minPtr = (__m128i*)(minRow + c*8);
+      __m128i* maxPtr = (__m128i*)(maxRow + c*8);
+      _mm_storeu_si128(minPtr, _mm_min_epi16(acc, _mm_loadu_si128(minPtr)));
+      _mm_storeu_si128(maxPtr, _mm_max_epi16(acc, _mm_loadu_si128(maxPtr)));
+      if(projections) {
+        int valid = numPlanes - c*8;
+        if(valid >= 8) _mm_storeu_si128((__m128i*)(projections + c*8), acc);
+        else {
+          int16_t lanes[8];
+          _mm_storeu_si128((__m128i*)lanes, acc);
+          memcpy(projections + c*8, lanes, sizeof(int16_t)*valid);
+        }
+      }
+    }
+    if(projections) projections += numPlanes;
+  }
+#else
+  int16_t acc[stride];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    memcpy(acc, entries + pixels[0]*stride, sizeof(int16_t)*stride);
+    for(int d = 1; d < numChannels; d++) {
+      const int16_t* entry = entries + (d*256 + pixels[d])*stride;
+      for(int plane = 0; plane < stride; plane++) acc[plane] += entry[plane];
+    }
+    for(int plane = 0; plane < numPlanes; plane++) {
+      if(acc[plane] > maxRow[plane]) maxRow[plane] = acc[plane];
+      if(acc[plane] < minRow[plane]) minRow[plane] = acc[plane];
+    }
+    if(projections) {
+      memcpy(projections, acc, sizeof(int16_t)*numPlanes);
+      projections += numPlanes;
+    }
+  }
+#endif
+}
+
+void encodeRowLUT(const ProjectionTable& table,
+                  const int16_t* projections, int cols,
+                  uint32_t* codes) {
+  int numPlanes = table.numPlanes;
+  const int16_t* midpoints = &table.midpoints[0];
+#ifdef HAVE_X86_KERNELS
+  int fullChunks = numPlanes / 8;
+  __m128i zero = _mm_setzero_si128();
+  for(int x = 0; x < cols; x++, projections += numPlanes) {
+    uint32_t code = 0;
+    int c = 0;
+    for(; c < fullChunks; c++) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(projections + c*8));
+      __m128i m = _mm_loadu_si128((const __m128i*)(midpoints + c*8));
+      __m128i gt = _mm_packs_epi16(_mm_cmpgt_epi16(v, m), zero);
+      code |= (uint32_t)(_mm_movemask_epi8(gt) & 0xff) << (c*8);
+    }
+    for(int plane = c*8; plane < numPlanes; plane++)
+      if(projections[plane] > midpoints[plane]) code |= 1u << plane;
+    codes[x] = code;
+  }
+#else
+  for(int x = 0; x < cols; x++, projections += numPlanes) {
+    uint32_t code = 0;
+    for(int plane = 0; plane < numPlanes; plane++)
+      if(projections[plane] > midpoints[plane]) code |= 1u << plane;
+    codes[x] = code;
+  }
+#endif
+}
+
+void projectEncodeRowLUT(const ProjectionTable& table,
+                         const uint8_t* pixels, int cols,
+                         uint32_t* codes) {
+  int numChannels = table.numChannels;
+  int numPlanes = table.numPlanes;
+  int stride = table.paddedPlanes;
+  const int16_t* entries = &table.entries[0];
+  const int16_t* midpoints = &table.midpoints[0];
+#ifdef HAVE_X86_KERNELS
+  int numChunks = stride / 8;
+  uint32_t validBits = codeMask(numPlanes);
+  __m128i zero = _mm_setzero_si128();
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    uint32_t code = 0;
+    for(int c = 0; c < numChunks; c++) {
+      const int16_t* e = entries + c*8;
+      __m128i acc = _mm_loadu_si128((const __m128i*)(e + pixels[0]*stride));
+      for(int d = 1; d < numChannels; d++) {
+        const __m128i* entry = (const __m128i*)(e + (d*256 + pixels[d])*stride);
+        acc = _mm_add_epi16(acc, _mm_loadu_si128(entry));
+      }
+      __m128i m = _mm_loadu_si128((const __m128i*)(midpoints + c*8));
+      __m128i gt = _mm_packs_epi16(_mm_cmpgt_epi16(acc, m), zero);
+      code |= (uint32_t)(_mm_movemask_epi8(gt) & 0xff) << (c*8);
+    }
+    codes[x] = code & validBits;
+  }
+#else
+  int16_t acc[stride];
+  for(int x = 0; x < cols; x++, pixels += numChannels) {
+    memcpy(acc, entries + pixels[0]*stride, sizeof(int16_t)*stride);
+    for(int d = 1; d < numChannels; d++) {
+      const int16_t* entry = entries + (d*256 + pixels[d])*stride;
+      for(int plane = 0; plane < stride; plane++) acc[plane] += entry[plane];
+    }
+    uint32_t code = 0;
+    for(int plane = 0; plane < numPlanes; plane++)
+      if(acc[plane] > midpoints[plane]) code |= 1u << plane;
+    codes[x] = code;
+  }
+#endif
+}
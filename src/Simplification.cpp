@@ -1,120 +1,391 @@
 #include <opencv2/opencv.hpp>
-#include <map>
-#include <queue>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include "Instrumentation.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
-// Compute the union of edges in all color channels
-void triChromaticEdges(const cv::Mat& imgColor, cv::Mat& edgeMask) {
-  cv::Mat chan1(imgColor.rows, imgColor.cols, CV_8U);
-  cv::Mat chan2(imgColor.rows, imgColor.cols, CV_8U);
-  cv::Mat chan3(imgColor.rows, imgColor.cols, CV_8U);
-  cv::Mat chanArray[] = {chan1, chan2, chan3};
-  cv::split(imgColor, chanArray);
-  double t1 = 32;
-  double t2 = 128;
-  cv::Mat edges2(imgColor.rows, imgColor.cols, CV_8U);
-  cv::Mat edges3(imgColor.rows, imgColor.cols, CV_8U);
-  cv::Canny(chan1, edgeMask, t1, t2);
-  cv::Canny(chan2, edges2, t1, t2);
-  cv::Canny(chan3, edges3, t1, t2);
-  cv::bitwise_or(edgeMask, edges2, edgeMask);
-  cv::bitwise_or(edgeMask, edges3, edgeMask);
+// Edge support is the Sobel gradient magnitude (L1 norm) of a gray
+// version of the image, ramped from 0 at EDGE_LOW to 255 at
+// EDGE_HIGH, and then dilated by taking its maximum over each pixel's
+// 3x3 neighborhood. EDGE_LOW and EDGE_HIGH are the hysteresis
+// thresholds that were used with Canny, and the dilation stands in for
+// the 3x3 box filter that was run over the Canny edges (which
+// saturated, so any pixel within one of an edge scored 255). A
+// boundary a pixel off a strong gradient's peak thus still scores 255.
+static const int EDGE_LOW = 32;
+static const int EDGE_HIGH = 128;
+
+// Convert row [y] of [img] to gray, weighting the channels in order as
+// CV_RGB2GRAY does (in 14-bit fixed point).
+static void grayRow(const cv::Mat& img, int y, uint8_t* gray) {
+  const uint8_t* pixel = img.ptr(y);
+  int numChannels = img.channels();
+  if(numChannels < 3) {
+    for(int x = 0; x < img.cols; x++, pixel += numChannels) gray[x] = *pixel;
+    return;
+  }
+  for(int x = 0; x < img.cols; x++, pixel += numChannels)
+    gray[x] = (pixel[0]*4899 + pixel[1]*9617 + pixel[2]*1868 + 8192) >> 14;
 }
 
-// Compute edges in a grayscale version of the supplied image.
-void triChromaticEdges2(const cv::Mat& imgColor, cv::Mat& edgeMask) {
-  cv::Mat g;
-  double t1 = 32;
-  double t2 = 128;
-  cv::cvtColor(imgColor, g, CV_RGB2GRAY);
-  cv::Canny(g, edgeMask, t1, t2);
+// Edge support at column [x] of the middle of three gray rows, before
+// dilation.
+static inline uint32_t edgeStrength(const uint8_t* above, const uint8_t* row,
+                                    const uint8_t* below, int x) {
+  int gx = (above[x+1] + 2*row[x+1] + below[x+1]) -
+           (above[x-1] + 2*row[x-1] + below[x-1]);
+  int gy = (below[x-1] + 2*below[x] + below[x+1]) -
+           (above[x-1] + 2*above[x] + above[x+1]);
+  int magnitude = abs(gx) + abs(gy);
+  if(magnitude <= EDGE_LOW) return 0;
+  if(magnitude >= EDGE_HIGH) return 255;
+  return (magnitude - EDGE_LOW) * 255 / (EDGE_HIGH - EDGE_LOW);
 }
 
+// Dilated edge support at the pixels of an image that lie on a
+// boundary, for a thread visiting rows in ascending order. Gradients
+// are only computed for the 3x3 neighborhoods of the pixels asked
+// about, and are kept for the three rows around the current one so
+// that neighboring boundary pixels share them. Gray rows are converted
+// on first use and kept for the five rows those gradients read.
+class EdgeSupport {
+public:
+  explicit EdgeSupport(const cv::Mat& img)
+    : img(img), grayRows(5*img.cols), strengths(3*img.cols),
+      stamps(3*img.cols, 0) {
+    for(int i = 0; i < 5; i++) grayY[i] = -1;
+  }
+
+  // Edge support at ([x], [y]), dilated over its 3x3 neighborhood.
+  uint32_t at(int y, int x) {
+    uint32_t weight = 0;
+    for(int r = y - 1; r <= y + 1; r++)
+      for(int c = x - 1; c <= x + 1; c++)
+        weight = max(weight, strength(r, c));
+    return weight;
+  }
+
+private:
+  const cv::Mat& img;
+  vector<uint8_t> grayRows;
+  int grayY[5];
+  // Undilated support of the rows y-1 through y+1, row r in slot r % 3.
+  // An entry is valid when its stamp is r + 1.
+  vector<uint8_t> strengths;
+  vector<uint32_t> stamps;
+
+  const uint8_t* gray(int y) {
+    int slot = y % 5;
+    uint8_t* row = &grayRows[(size_t)slot*img.cols];
+    if(grayY[slot] != y) {
+      grayRow(img, y, row);
+      grayY[slot] = y;
+    }
+    return row;
+  }
+
+  // Undilated edge support at ([x], [y]). The outermost rows and
+  // columns of the image have none.
+  uint32_t strength(int y, int x) {
+    if(y <= 0 || y >= img.rows - 1 || x <= 0 || x >= img.cols - 1) return 0;
+    size_t i = (size_t)(y % 3)*img.cols + x;
+    if(stamps[i] != (uint32_t)y + 1) {
+      strengths[i] = edgeStrength(gray(y - 1), gray(y), gray(y + 1), x);
+      stamps[i] = y + 1;
+    }
+    return strengths[i];
+  }
+};
+
 typedef struct EDGEINFO {
+  uint32_t neighbor;
   uint32_t edgeLength;
   uint32_t edgeWeight;
-  EDGEINFO() : edgeLength(0), edgeWeight(0) {}
 } EdgeInfo;
 
-typedef pair<uint32_t, uint32_t> Edge;
-typedef pair<float, Edge> WeightedEdge;
+// One boundary pixel's contribution to an edge: the code across the
+// boundary and the edge strength at the pixel.
+struct EdgeSample {
+  uint32_t neighbor;
+  uint32_t weight;
+};
 
-inline uint32_t lookupAndFlatten(vector<uint32_t>& v, uint32_t i) {
-  uint32_t dst = i;
-  while(v[dst]) dst = v[dst];
-  
-  // Now flatten the mapping
-  uint32_t tmp = i;
-  while(v[tmp]) {
-    uint32_t nxt = v[tmp];
-    v[tmp] = dst;
-    tmp = nxt;
-  }
-  return dst;
+inline bool byNeighbor(const EdgeSample& a, const EdgeSample& b) {
+  return a.neighbor < b.neighbor;
 }
 
-// Simplify a segmentation with a bias to preserving segment
-// boundaries that are supported by Canny edges. Returns the number of
-// distinct codes after simplification.
-int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes) {
-  cv::Mat edgeMask;
-  triChromaticEdges2(imgColor, edgeMask);
-  cv::boxFilter(edgeMask, edgeMask, CV_8U, cv::Size(3,3), cv::Point(-1,-1), false);
-  //cv::GaussianBlur(edgeMask, edgeMask, cv::Size(3,3), 0);
-
-  vector<map<uint32_t, EdgeInfo> > adj(numCodes);
-  for(int y = 1; y < imgCode.rows - 1; y++) {
-    uint32_t *code_ptr = (uint32_t*)imgCode.ptr(y);
-    uint8_t *edge_ptr = (uint8_t*)edgeMask.ptr(y);
-    uint32_t code, left, right, above, below;
-    left = *code_ptr;
-    code_ptr++;
-    edge_ptr++;
-    code = *code_ptr;
-    for(int x = 1; x < imgCode.cols - 1; x++, code_ptr++, edge_ptr++) {
-      right = *(code_ptr+1);
-      above = *(code_ptr-imgCode.cols);
-      below = *(code_ptr+imgCode.cols);
-      map<uint32_t, EdgeInfo>& ns = adj[code];
-      if(code != left) {
-        EdgeInfo& e = ns[left];
-        e.edgeLength++;
-        e.edgeWeight+=(uint32_t)*edge_ptr;
+// Region adjacency in compressed sparse row form. The edges of
+// component [c] are edges[edgeStart[c]] up to (not including)
+// edges[edgeEnd[c]], in ascending order of neighbor.
+struct RegionAdjacency {
+  vector<uint32_t> edgeStart;
+  vector<uint32_t> edgeEnd;
+  vector<EdgeInfo> edges;
+};
+
+// Collect the boundaries between the components of [imgCode], and the
+// edge support along them in [imgColor]. Each thread gathers an edge
+// sample for every neighbor across a boundary from its own rows, with
+// edge support computed only around boundary pixels. The samples are
+// grouped by component with a counting sort (in thread order, so the
+// grouping does not depend on timing), and each component's samples
+// are then sorted by neighbor and summed into one edge per neighbor.
+static void buildAdjacency(const cv::Mat& imgColor, const cv::Mat& imgCode,
+                           int numCodes, RegionAdjacency& adj) {
+  int maxThreads = 1;
+#ifdef _OPENMP
+  maxThreads = omp_get_max_threads();
+#endif
+  vector<vector<uint32_t> > threadCodes(maxThreads);
+  vector<vector<EdgeSample> > threadSamples(maxThreads);
+  // Sample counts per thread and component, sized once the number of
+  // threads actually running is known.
+  vector<uint32_t> counts;
+
+  int numThreads = 1;
+  #pragma omp parallel
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    #pragma omp single
+    {
+#ifdef _OPENMP
+      numThreads = omp_get_num_threads();
+#endif
+      counts.assign((size_t)numThreads*numCodes, 0);
+    }
+    vector<uint32_t>& codes = threadCodes[thread];
+    vector<EdgeSample>& samples = threadSamples[thread];
+    uint32_t* count = &counts[(size_t)thread*numCodes];
+    EdgeSupport edgeSupport(imgColor);
+
+    #pragma omp for schedule(static)
+    for(int y = 1; y < imgCode.rows - 1; y++) {
+      const uint32_t *code_ptr = (const uint32_t*)imgCode.ptr(y);
+      uint32_t code, left, right, above, below;
+      left = *code_ptr;
+      code_ptr++;
+      code = *code_ptr;
+      for(int x = 1; x < imgCode.cols - 1; x++, code_ptr++) {
+        right = *(code_ptr+1);
+        above = *(code_ptr-imgCode.cols);
+        below = *(code_ptr+imgCode.cols);
+        uint32_t neighbors[4] = {left, above, right, below};
+        uint32_t weight = 0xffffffff;
+        for(int n = 0; n < 4; n++) {
+          if(code == neighbors[n]) continue;
+          if(weight == 0xffffffff) weight = edgeSupport.at(y, x);
+          EdgeSample sample = { neighbors[n], weight };
+          codes.push_back(code);
+          samples.push_back(sample);
+          count[code]++;
+        }
+        left = code;
+        code = right;
       }
-      if(code != above) {
-        EdgeInfo& e = ns[above];
+    }
+  }
+
+  // Lay out each component's samples contiguously, and make room for
+  // its edges in the same positions.
+  adj.edgeStart.resize(numCodes);
+  adj.edgeEnd.resize(numCodes);
+  uint32_t total = 0;
+  for(int c = 0; c < numCodes; c++) {
+    adj.edgeStart[c] = total;
+    for(int t = 0; t < numThreads; t++) {
+      uint32_t n = counts[(size_t)t*numCodes + c];
+      counts[(size_t)t*numCodes + c] = total;
+      total += n;
+    }
+  }
+  vector<EdgeSample> samples(total);
+  #pragma omp parallel for schedule(static, 1)
+  for(int t = 0; t < numThreads; t++) {
+    uint32_t* next = &counts[(size_t)t*numCodes];
+    const vector<uint32_t>& codes = threadCodes[t];
+    for(size_t i = 0; i < codes.size(); i++)
+      samples[next[codes[i]]++] = threadSamples[t][i];
+  }
+
+  adj.edges.resize(total);
+  #pragma omp parallel for schedule(dynamic, 64)
+  for(int c = 0; c < numCodes; c++) {
+    uint32_t start = adj.edgeStart[c];
+    uint32_t end = c + 1 < numCodes ? adj.edgeStart[c+1] : total;
+    sort(samples.begin() + start, samples.begin() + end, byNeighbor);
+    uint32_t out = start;
+    for(uint32_t i = start; i < end; ) {
+      EdgeInfo& e = adj.edges[out++];
+      e.neighbor = samples[i].neighbor;
+      e.edgeLength = 0;
+      e.edgeWeight = 0;
+      for(; i < end && samples[i].neighbor == e.neighbor; i++) {
         e.edgeLength++;
-        e.edgeWeight+=(uint32_t)*edge_ptr;
+        e.edgeWeight += samples[i].weight;
       }
-      if(code != right) {
-        EdgeInfo& e = ns[right];
-        e.edgeLength++;
-        e.edgeWeight+=(uint32_t)*edge_ptr;
+    }
+    adj.edgeEnd[c] = out;
+  }
+}
+
+typedef pair<uint32_t, uint32_t> Edge;
+typedef pair<float, Edge> WeightedEdge;
+
+// Edges awaiting a merge, popped in descending order of priority
+// (and then of their endpoints), which is the order a
+// std::priority_queue<WeightedEdge> would pop them in. Every edge is
+// pushed before the first is popped, so the queue is filled once and
+// drained once.
+//
+// Edges are spread over buckets by the high bits of their priority.
+// For non-negative floats the bit patterns order the same way as the
+// values, so the buckets are in priority order, and only the few edges
+// sharing a bucket need a comparison sort, which each bucket gets when
+// it is reached. Edges with priorities below [minPriority] would never
+// be merged and are dropped as they are pushed.
+class EdgeBucketQueue {
+public:
+  EdgeBucketQueue(float minPriority) : minPriority(minPriority),
+                                       bucket(-1), next(0), end(0) {}
+
+  void push(float priority, uint32_t src, uint32_t dst) {
+    if(!(priority >= minPriority)) return;
+    pending.push_back(WeightedEdge(priority, Edge(src, dst)));
+  }
+
+  bool empty() {
+    while(next == end) {
+      if(bucket < 0) {
+        if(!sorted.empty() || pending.empty()) return true;
+        distribute();
       }
-      if(code != below) {
-        EdgeInfo& e = ns[below];
-        e.edgeLength++;
-        e.edgeWeight+=(uint32_t)*edge_ptr;
+      else {
+        bucket--;
+        if(bucket < 0) return true;
+        next = bucketStart[bucket];
+        end = bucketStart[bucket + 1];
+        sort(sorted.begin() + next, sorted.begin() + end,
+             greater<WeightedEdge>());
       }
-      left = code;
-      code = right;
     }
+    return false;
+  }
+
+  // Only valid when the queue is not empty().
+  const WeightedEdge& top() const { return sorted[next]; }
+  void pop() { next++; }
+
+private:
+  static const int BUCKET_SHIFT = 16;
+
+  float minPriority;
+  uint32_t minKey;
+  vector<WeightedEdge> pending;
+  vector<WeightedEdge> sorted;
+  vector<uint32_t> bucketStart;
+  int bucket;
+  uint32_t next, end;
+
+  inline uint32_t bucketOf(float priority) const {
+    uint32_t bits;
+    memcpy(&bits, &priority, sizeof(bits));
+    return (bits >> BUCKET_SHIFT) - minKey;
+  }
+
+  // Counting sort the pushed edges into their buckets, and start at
+  // the bucket past the highest.
+  void distribute() {
+    float lowest = minPriority > 0.0f ? minPriority : 0.0f;
+    memcpy(&minKey, &lowest, sizeof(minKey));
+    minKey >>= BUCKET_SHIFT;
+    uint32_t numBuckets = 0;
+    for(size_t i = 0; i < pending.size(); i++)
+      numBuckets = max(numBuckets, bucketOf(pending[i].first) + 1);
+    bucketStart.assign(numBuckets + 1, 0);
+    for(size_t i = 0; i < pending.size(); i++)
+      bucketStart[bucketOf(pending[i].first) + 1]++;
+    for(uint32_t i = 0; i < numBuckets; i++)
+      bucketStart[i + 1] += bucketStart[i];
+    sorted.resize(pending.size());
+    vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for(size_t i = 0; i < pending.size(); i++)
+      sorted[fill[bucketOf(pending[i].first)]++] = pending[i];
+    vector<WeightedEdge>().swap(pending);
+    bucket = numBuckets;
+    next = end = 0;
+  }
+};
+
+// Union-find over component codes with path halving and union by
+// size. Each set also carries the code it is known by, which is not
+// necessarily its root.
+class CodeSets {
+public:
+  CodeSets(int numCodes) : parent(numCodes), size(numCodes, 1),
+                           name(numCodes) {
+    for(int i = 0; i < numCodes; i++) parent[i] = name[i] = i;
+  }
+
+  inline uint32_t find(uint32_t i) {
+    while(parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  // Merge the set holding [dst] into the set holding [src], which
+  // gives the merged set its name. Returns false if they were already
+  // one set.
+  inline bool merge(uint32_t src, uint32_t dst) {
+    src = find(src);
+    dst = find(dst);
+    if(src == dst) return false;
+    uint32_t mergedName = name[src];
+    if(size[src] < size[dst]) swap(src, dst);
+    parent[dst] = src;
+    size[src] += size[dst];
+    name[src] = mergedName;
+    return true;
   }
 
+  inline uint32_t nameOf(uint32_t i) { return name[find(i)]; }
+
+private:
+  vector<uint32_t> parent;
+  vector<uint32_t> size;
+  vector<uint32_t> name;
+};
+
+// Simplify a segmentation with a bias to preserving segment
+// boundaries that are supported by image edges. Returns the number of
+// distinct codes after simplification.
+int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes) {
+  CallTrace trace(TRACE_SIMPLIFY);
+  RegionAdjacency adj;
+  buildAdjacency(imgColor, imgCode, numCodes, adj);
+
   // Now we can build a heap structure of all adjacencies prioritized
   // by normalized edge weight.
-  priority_queue<WeightedEdge> q;
-  for(int i = 0; i < adj.size(); i++) {
+  // Edges weighted below 1 are never merged.
+  EdgeBucketQueue q(1.0f);
+  for(int i = 0; i < numCodes; i++) {
     int totalBoundaryWeight = 0;
     //int totalBoundaryLength = 0;
-    map<uint32_t, EdgeInfo>& ns = adj[i];
-    if(ns.size() == 0) continue;
-    for(map<uint32_t, EdgeInfo>::const_iterator it = ns.begin();
-        it != ns.end();
-        it++) {
-      totalBoundaryWeight += (*it).second.edgeWeight;
-      //totalBoundaryLength += (*it).second.edgeLength;
+    uint32_t begin = adj.edgeStart[i];
+    uint32_t end = adj.edgeEnd[i];
+    if(begin == end) continue;
+    for(uint32_t j = begin; j < end; j++) {
+      totalBoundaryWeight += adj.edges[j].edgeWeight;
+      //totalBoundaryLength += adj.edges[j].edgeLength;
     }
 
     // If a component has a long boundary with moderate edge support,
@@ -124,54 +395,53 @@ int simplify(const cv::Mat& imgColor, cv::Mat& imgCode, int numCodes) {
     // Alternately, if a component has a short boundary, we push a
     // single edge to be collapsed.
     if(totalBoundaryWeight < 200*128) {
-      q.push(pair<float,Edge>(1000000.0f, pair<uint32_t,uint32_t>(i,(*ns.begin()).first)));
+      q.push(1000000.0f, i, adj.edges[begin].neighbor);
       continue;
     }
 
     // Finally, if an edge is of moderate length we push weighted
     // edges onto the heap.
-    for(map<uint32_t, EdgeInfo>::const_iterator it = ns.begin();
-        it != ns.end();
-        it++) {
+    for(uint32_t j = begin; j < end; j++) {
+      const EdgeInfo& e = adj.edges[j];
       // We have a max-heap, so the desire to remove an edge is
       // proportional to the inverse of its average weight.
-      float w = (float)((*it).second.edgeLength) / 
-                (float)((*it).second.edgeWeight);
+      float w = (float)(e.edgeLength) / 
+                (float)(e.edgeWeight);
 
-      q.push(pair<float, Edge>(w, pair<uint32_t, uint32_t>(i, (*it).first)));
+      q.push(w, i, e.neighbor);
     }
   }
 
-  // Iterate until all edge segments are supported by Canny or their
-  // own length.
-  vector<uint32_t> renamer(numCodes, 0);
+  // Iterate until all edge segments are supported by edges or their
+  // own length. Edges whose endpoints have already been merged are
+  // simply skipped as they come up.
+  CodeSets sets(numCodes);
   int remainingCodes = numCodes;
-  while(q.size() > 0) {
+  while(!q.empty()) {
     const WeightedEdge& we = q.top();
     if(remainingCodes <= 20 && we.first < 1000000) break;
-    if(we.first < 1) break;
-
-    // Resolve the endpoints of the edge
-    uint32_t src = we.second.first;
-    uint32_t dst = we.second.second;
-    src = lookupAndFlatten(renamer, src);
-    dst = lookupAndFlatten(renamer, dst);
 
     // merge the codes that share this edge
-    if(src != dst) { remainingCodes--; renamer[dst] = src; }
+    if(sets.merge(we.second.first, we.second.second)) remainingCodes--;
 
     q.pop();
   }
- 
-  // Final flattening pass
-  for(int i = 0; i < renamer.size(); i++) lookupAndFlatten(renamer, i);
 
-  // Now apply the renamer map to imgCode
+  // Now give every pixel the name of its merged code
+  vector<uint32_t> renamer(numCodes);
+  for(int i = 0; i < numCodes; i++) renamer[i] = sets.nameOf(i);
   {
     uint32_t *row = (uint32_t*)imgCode.ptr(0);
     for(int i = 0; i < imgCode.rows*imgCode.cols; i++, row++) {
-      *row = renamer[*row] ? renamer[*row] : *row;
+      *row = renamer[*row];
     }
   }
+  if(trace.active) {
+    trace.record.count = remainingCodes;
+    trace.record.bytesAllocated =
+      adj.edges.capacity()*sizeof(EdgeInfo) +
+      (adj.edgeStart.capacity() + adj.edgeEnd.capacity() +
+       renamer.capacity())*sizeof(uint32_t);
+  }
   return remainingCodes;
 }
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <string.h>
+#include "SparseHistogram.h"
+#include "HammingDistance.h"
+
+using namespace std;
+
+const uint32_t SparseHistogram::NOT_FOUND;
+
+SparseHistogram::SparseHistogram() {
+  slotShift = 64;
+  rehash(1024);
+}
+
+void SparseHistogram::clear() {
+  codes.clear();
+  counts.clear();
+  colorSums.clear();
+  fill(slots.begin(), slots.end(), NOT_FOUND);
+}
+
+void SparseHistogram::rehash(size_t numSlots) {
+  slots.assign(numSlots, NOT_FOUND);
+  slotMask = numSlots - 1;
+  slotShift = 64 - __builtin_ctzll(numSlots);
+  for(uint32_t entry = 0; entry < codes.size(); entry++) {
+    uint64_t slot = hashSlot(codes[entry]);
+    while(slots[slot] != NOT_FOUND) slot = (slot + 1) & slotMask;
+    slots[slot] = entry;
+  }
+}
+
+void SparseHistogram::merge(const SparseHistogram& other) {
+  for(uint32_t i = 0; i < other.size(); i++) {
+    uint32_t entry = insert(other.codes[i]);
+    counts[entry] += other.counts[i];
+    for(int d = 0; d < 3; d++)
+      colorSums[entry*3 + d] += other.colorSums[i*3 + d];
+  }
+}
+
+struct CodeOrder {
+  const uint64_t* codes;
+  bool operator()(uint32_t a, uint32_t b) const {
+    return codes[a] < codes[b];
+  }
+};
+
+void SparseHistogram::sortByCode() {
+  uint32_t n = size();
+  vector<uint32_t> order(n);
+  for(uint32_t i = 0; i < n; i++) order[i] = i;
+  CodeOrder byCode = { &codes[0] };
+  sort(order.begin(), order.end(), byCode);
+
+  vector<uint64_t> sortedCodes(n), sortedSums(n*3);
+  vector<uint32_t> sortedCounts(n);
+  for(uint32_t i = 0; i < n; i++) {
+    sortedCodes[i] = codes[order[i]];
+    sortedCounts[i] = counts[order[i]];
+    memcpy(&sortedSums[i*3], &colorSums[order[i]*3], sizeof(uint64_t)*3);
+  }
+  codes.swap(sortedCodes);
+  counts.swap(sortedCounts);
+  colorSums.swap(sortedSums);
+  rehash(slots.size());
+}
+
+// Returns true if some occupied code reached by flipping between 1
+// and [depth] of the bits of [code] below bit [top] has a count of at
+// least [pop].
+static bool hasPopularNeighbor(const SparseHistogram& histogram,
+                               uint64_t code, uint32_t pop,
+                               int top, int depth) {
+  for(int bit = top - 1; bit >= 0; bit--) {
+    uint64_t neighbor = code ^ ((uint64_t)1 << bit);
+    uint32_t entry = histogram.find(neighbor);
+    if(entry != SparseHistogram::NOT_FOUND && histogram.counts[entry] >= pop)
+      return true;
+    if(depth > 1 &&
+       hasPopularNeighbor(histogram, neighbor, pop, bit, depth - 1))
+      return true;
+  }
+  return false;
+}
+
+struct PopularityOrder {
+  const uint32_t* counts;
+  bool operator()(uint32_t a, uint32_t b) const {
+    return counts[a] > counts[b];
+  }
+};
+
+void sparseHammingMaxima(const SparseHistogram& histogram,
+                         int numPlanes, int hammingK,
+                         vector<uint64_t>& hMaxima) {
+  if(hammingK > numPlanes) hammingK = numPlanes;
+  uint32_t n = histogram.size();
+  if(n == 0) return;
+
+  // Number of codes within distance hammingK of any code.
+  double numNeighbors = 0.0, choose = 1.0;
+  for(int d = 1; d <= hammingK; d++) {
+    choose = choose * (numPlanes - d + 1) / d;
+    numNeighbors += choose;
+  }
+
+  // Entries by descending count. Only the entries that precede a
+  // code's last tie in this order can keep it from being a maximum.
+  vector<uint32_t> byCount(n);
+  for(uint32_t i = 0; i < n; i++) byCount[i] = i;
+  PopularityOrder popularity = { &histogram.counts[0] };
+  stable_sort(byCount.begin(), byCount.end(), popularity);
+  vector<uint32_t> rivals(n);
+  for(uint32_t r = n; r > 0; r--) {
+    bool lastTie = r == n ||
+      histogram.counts[byCount[r]] != histogram.counts[byCount[r-1]];
+    rivals[byCount[r-1]] = lastTie ? r : rivals[byCount[r]];
+  }
+
+  // Rivals are compared a block at a time with the batched distance
+  // kernel, stopping at the first block holding a neighbor.
+  vector<uint64_t> codesByCount(n);
+  for(uint32_t r = 0; r < n; r++) codesByCount[r] = histogram.codes[byCount[r]];
+  const HammingDistanceKernels& kernels = hammingDistanceKernels();
+  const int blockSize = 256;
+
+  vector<uint8_t> isMaximum(n);
+  #pragma omp parallel
+  {
+    uint8_t distances[blockSize];
+
+    #pragma omp for schedule(dynamic, 256)
+    for(int i = 0; i < (int)n; i++) {
+      uint64_t code = histogram.codes[i];
+      uint32_t pop = histogram.counts[i];
+      bool ismax = true;
+      if(rivals[i] <= numNeighbors) {
+        for(uint32_t r = 0; r < rivals[i] && ismax; r += blockSize) {
+          int len = min(rivals[i] - r, (uint32_t)blockSize);
+          kernels.distances64(code, &codesByCount[r], len, distances);
+          for(int j = 0; j < len; j++) {
+            if(distances[j] >= 1 && distances[j] <= hammingK) {
+              ismax = false;
+              break;
+            }
+          }
+        }
+      }
+      else {
+        ismax = !hasPopularNeighbor(histogram, code, pop, numPlanes, hammingK);
+      }
+      isMaximum[i] = ismax;
+    }
+  }
+
+  for(uint32_t i = 0; i < n; i++)
+    if(isMaximum[i]) hMaxima.push_back(histogram.codes[i]);
+}
+
+void sparseMapToMaxima(SparseHistogram& histogram,
+                       const vector<uint64_t>& hMaxima,
+                       vector<uint32_t>& mapping) {
+  uint32_t n = histogram.size();
+  mapping.resize(n);
+  int numMaxima = hMaxima.size();
+  if(numMaxima == 0) return;
+
+  // The maxima map to themselves, and are compared by their mean
+  // color, while other codes are compared by their summed color.
+  vector<uint32_t> maximaEntries(numMaxima);
+  vector<float> maximaColors(numMaxima*3);
+  vector<uint8_t> isMaximum(n, 0);
+  for(int m = 0; m < numMaxima; m++) {
+    uint32_t entry = histogram.find(hMaxima[m]);
+    maximaEntries[m] = entry;
+    isMaximum[entry] = 1;
+    mapping[entry] = m;
+    float s = 1.0f / (float)histogram.counts[entry];
+    for(int d = 0; d < 3; d++)
+      maximaColors[m*3 + d] = (float)histogram.colorSums[entry*3 + d] * s;
+  }
+
+  // Find each code's nearest maximum, preferring the maximum whose
+  // color is closest and then the lowest code. Distances to all the
+  // maxima are computed at once.
+  const HammingDistanceKernels& kernels = hammingDistanceKernels();
+  #pragma omp parallel
+  {
+    vector<uint8_t> distances(numMaxima);
+
+    #pragma omp for schedule(dynamic, 256)
+    for(int i = 0; i < (int)n; i++) {
+      if(isMaximum[i]) continue;
+      uint64_t code = histogram.codes[i];
+      kernels.distances64(code, &hMaxima[0], numMaxima, &distances[0]);
+      float color[3];
+      for(int d = 0; d < 3; d++)
+        color[d] = (float)histogram.colorSums[i*3 + d];
+
+      int minDist = 65;
+      int bestCenter = 0;
+      float bestColorDiff = 0.0f;
+      for(int m = 0; m < numMaxima; m++) {
+        int dist = distances[m];
+        if(dist > minDist) continue;
+        float diff = 0.0f;
+        for(int d = 0; d < 3; d++) {
+          float delta = maximaColors[m*3 + d] - color[d];
+          diff += delta*delta;
+        }
+        if(dist < minDist || diff < bestColorDiff) {
+          minDist = dist;
+          bestCenter = m;
+          bestColorDiff = diff;
+        }
+      }
+      mapping[i] = bestCenter;
+    }
+  }
+
+  for(uint32_t i = 0; i < n; i++)
+    if(!isMaximum[i])
+      histogram.counts[maximaEntries[mapping[i]]] += histogram.counts[i];
+}
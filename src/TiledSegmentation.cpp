@@ -0,0 +1,475 @@
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <limits.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TiledSegmentation.h"
+#include "Connected.h"
+
+using namespace std;
+
+// Marks a label written to the image as the index of a region still
+// open at the end of its row of tiles, rather than a final number.
+static const uint32_t OPEN_REGION = 0x80000000u;
+
+void hammingMaxima(const vector<uint32_t>& bins,
+                   const vector<uint32_t>& activeBins,
+                   int numPlanes,
+                   int hammingK,
+                   HammingNeighborhood& neighborhood,
+                   vector<uint32_t>& hMaxima);
+void mapToMaxima(vector<uint32_t>& bins,
+                 const vector<uint32_t>& activeBins,
+                 const vector<uint32_t>& hMaxima,
+                 float* binColors,
+                 uint32_t* binMapping,
+                 HammingNeighborhood& neighborhood,
+                 MaximaSearch& search);
+vector<float> discriminativePower(int numPlanes, vector<uint32_t>& maxima);
+vector<float> planeCorrelation(int numPlanes, vector<uint32_t>& maxima);
+
+TiledSegmenter::TiledSegmenter(const vector<float>& planes,
+                               uint32_t hammingK,
+                               int maxRetries)
+  : tileSize(1024), convert(NULL), planes(planes), hammingK(hammingK),
+    maxRetries(maxRetries), lastWidth(0), lastHeight(0), lastMaxima(0),
+    lastAttempts(0), lastTileComponents(0), lastRegions(0),
+    pixels(NULL), pixelsOffset(0), pixelsLength(0),
+    labels(NULL), labelsLength(0), width(0), height(0), numRegions(0) {
+  ctx.streamProjections = true;
+}
+
+// Read the header of a binary PPM of [size] bytes, leaving [offset] at
+// its first byte of pixel data.
+static bool parsePPMHeader(const uint8_t* data, size_t size,
+                           int& width, int& height, size_t& offset) {
+  if(size < 2 || data[0] != 'P' || data[1] != '6') return false;
+  size_t pos = 2;
+  long values[3];
+  for(int i = 0; i < 3; i++) {
+    while(pos < size) {
+      if(data[pos] == '#')
+        while(pos < size && data[pos] != '\n') pos++;
+      else if(isspace(data[pos])) pos++;
+      else break;
+    }
+    if(pos >= size || !isdigit(data[pos])) return false;
+    long v = 0;
+    while(pos < size && isdigit(data[pos])) {
+      v = v*10 + (data[pos++] - '0');
+      if(v > INT_MAX) return false;
+    }
+    values[i] = v;
+  }
+  // A single whitespace byte separates the header from the pixels.
+  if(pos >= size || !isspace(data[pos])) return false;
+  if(values[0] < 1 || values[1] < 1 || values[2] < 1 || values[2] > 255)
+    return false;
+  width = values[0];
+  height = values[1];
+  offset = pos + 1;
+  return size - offset >= (size_t)width*height*3;
+}
+
+int TiledSegmenter::segment(const char* inputPath, const char* outputPath) {
+  lastWidth = lastHeight = lastMaxima = lastAttempts = 0;
+  lastTileComponents = lastRegions = 0;
+
+  int in = open(inputPath, O_RDONLY);
+  if(in < 0) return -1;
+  struct stat st;
+  void* inMap = MAP_FAILED;
+  if(fstat(in, &st) == 0 && st.st_size > 0)
+    inMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+  close(in);
+  if(inMap == MAP_FAILED) return -1;
+  pixels = (const uint8_t*)inMap;
+  pixelsLength = st.st_size;
+  if(!parsePPMHeader(pixels, pixelsLength, width, height, pixelsOffset)) {
+    munmap(inMap, pixelsLength);
+    return -1;
+  }
+  // Tiles are read in passes, row of tiles by row of tiles.
+  madvise(inMap, pixelsLength, MADV_SEQUENTIAL);
+
+  labelsLength = (size_t)width*height*sizeof(uint32_t);
+  int out = open(outputPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  void* outMap = MAP_FAILED;
+  if(out >= 0 && ftruncate(out, labelsLength) == 0)
+    outMap = mmap(NULL, labelsLength, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  out, 0);
+  if(out >= 0) close(out);
+  if(outMap == MAP_FAILED) {
+    munmap(inMap, pixelsLength);
+    return -1;
+  }
+  labels = (uint32_t*)outMap;
+
+  lastWidth = width;
+  lastHeight = height;
+  int found = segmentMapped();
+
+  munmap(outMap, labelsLength);
+  munmap(inMap, pixelsLength);
+  pixels = NULL;
+  labels = NULL;
+  tileColor.release();
+  tileCodes.release();
+  vector<uint32_t>().swap(parent);
+  vector<uint32_t>().swap(rowFates);
+  vector<vector<uint32_t> >().swap(openFates);
+  return found;
+}
+
+int TiledSegmenter::numTiles() const {
+  int across = (width + tileSize - 1) / tileSize;
+  int down = (height + tileSize - 1) / tileSize;
+  return across * down;
+}
+
+cv::Rect TiledSegmenter::tileAt(int index) const {
+  int across = (width + tileSize - 1) / tileSize;
+  int x = (index % across) * tileSize, y = (index / across) * tileSize;
+  return cv::Rect(x, y, min(tileSize, width - x), min(tileSize, height - y));
+}
+
+// Make [tileColor] the tile's pixels, converted if need be. Without a
+// conversion the pixels are used where they are mapped.
+void TiledSegmenter::loadTile(const cv::Rect& tile) {
+  size_t first = pixelsOffset + ((size_t)tile.y*width + tile.x)*3;
+  cv::Mat view(tile.height, tile.width, CV_8UC3, (void*)(pixels + first),
+               (size_t)width*3);
+  if(convert) convert(view, tileColor);
+  else tileColor = view;
+}
+
+// Encode [tileColor] against the planes and midpoints held by
+// ctx.layout, into [tileCodes].
+void TiledSegmenter::encodeTile(const cv::Rect& tile) {
+  const ProjectionKernels& kernels = projectionKernels(ctx.isa);
+  tileCodes.create(tile.height, tile.width, CV_32S);
+  #pragma omp parallel for
+  for(int y = 0; y < tile.height; y++)
+    kernels.projectEncodeRow(ctx.layout, tileColor.ptr(y), tile.width,
+                             (uint32_t*)tileCodes.ptr(y));
+}
+
+// Let the kernel reclaim the mapped pages of rows [y0, y1) of the
+// image and of the labels, which are read again from (or written back
+// to) their files if they are needed later.
+static void releasePages(const void* base, size_t begin, size_t end) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  begin -= begin % page;
+  end += (page - end % page) % page;
+  madvise((char*)base + begin, end - begin, MADV_DONTNEED);
+}
+
+void TiledSegmenter::releaseRows(int y0, int y1) {
+  size_t rowBytes = (size_t)width*3;
+  releasePages(pixels, pixelsOffset + y0*rowBytes,
+               min(pixelsLength, pixelsOffset + y1*rowBytes));
+  rowBytes = (size_t)width*sizeof(uint32_t);
+  releasePages(labels, y0*rowBytes, y1*rowBytes);
+}
+
+// Find the extrema of each plane's projections over the whole image,
+// set ctx.layout's midpoints from them, and then encode every tile
+// and count its codes and colors into ctx.bins and ctx.binColors.
+void TiledSegmenter::histogramPass(int numPlanes) {
+  int numChannels = planes.size() / numPlanes;
+  const ProjectionKernels& kernels = projectionKernels(ctx.isa);
+  ctx.layout.setPlanes(planes, numChannels);
+  int stride = ctx.layout.paddedPlanes;
+
+  // As in hammingHash, every row's extrema start from zero.
+  vector<float> minimums(numPlanes, 0.0f), maximums(numPlanes, 0.0f);
+  vector<float> rowExtrema(2*(size_t)tileSize*stride);
+  int tiles = numTiles();
+  for(int i = 0; i < tiles; i++) {
+    cv::Rect tile = tileAt(i);
+    loadTile(tile);
+    fill(rowExtrema.begin(), rowExtrema.end(), 0.0f);
+    #pragma omp parallel for
+    for(int y = 0; y < tile.height; y++) {
+      float* minRow = &rowExtrema[2*(size_t)y*stride];
+      kernels.projectRow(ctx.layout, tileColor.ptr(y), tile.width, NULL,
+                         minRow, minRow + stride);
+    }
+    for(int y = 0; y < tile.height; y++) {
+      const float* minRow = &rowExtrema[2*(size_t)y*stride];
+      const float* maxRow = minRow + stride;
+      for(int plane = 0; plane < numPlanes; plane++) {
+        minimums[plane] = min(minimums[plane], minRow[plane]);
+        maximums[plane] = max(maximums[plane], maxRow[plane]);
+      }
+    }
+    if(tile.x + tile.width == width) releaseRows(tile.y, tile.y + tile.height);
+  }
+  ctx.layout.setMidpoints(&minimums[0], &maximums[0]);
+
+  // Forget the previous histogram.
+  vector<uint32_t>& bins = ctx.bins;
+  vector<uint32_t>& active = ctx.activeBins;
+  if(colorSums.size() != bins.size()*3) colorSums.assign(bins.size()*3, 0);
+  for(size_t a = 0; a < active.size(); a++) {
+    bins[active[a]] = 0;
+    memset(&colorSums[active[a]*3], 0, sizeof(uint64_t)*3);
+  }
+  active.clear();
+
+  int summed = min(numChannels, 3);
+  for(int i = 0; i < tiles; i++) {
+    cv::Rect tile = tileAt(i);
+    loadTile(tile);
+    encodeTile(tile);
+    for(int y = 0; y < tile.height; y++) {
+      const uint32_t* codes = (const uint32_t*)tileCodes.ptr(y);
+      const uint8_t* color = tileColor.ptr(y);
+      for(int x = 0; x < tile.width; x++, color += numChannels) {
+        uint32_t code = codes[x];
+        if(bins[code]++ == 0) active.push_back(code);
+        uint64_t* sum = &colorSums[code*3];
+        for(int d = 0; d < summed; d++) sum[d] += color[d];
+      }
+    }
+    if(tile.x + tile.width == width) releaseRows(tile.y, tile.y + tile.height);
+  }
+
+  sort(active.begin(), active.end());
+  for(size_t a = 0; a < active.size(); a++) {
+    uint32_t code = active[a];
+    for(int d = 0; d < 3; d++)
+      ctx.binColors[code*3 + d] = (float)colorSums[code*3 + d];
+  }
+}
+
+uint32_t TiledSegmenter::findRoot(uint32_t label) {
+  while(parent[label] != label) {
+    parent[label] = parent[parent[label]];
+    label = parent[label];
+  }
+  return label;
+}
+
+// Join the components of labels [a] and [b]. The smaller label is
+// kept as the root, so every label's parent is no greater than it.
+void TiledSegmenter::join(uint32_t a, uint32_t b) {
+  a = findRoot(a);
+  b = findRoot(b);
+  if(a < b) parent[b] = a;
+  else if(b < a) parent[a] = b;
+}
+
+// Encode, map and label [tile], write its labels, and join its
+// components to those of the tiles to its left and above wherever the
+// same maximum continues across the seam.
+void TiledSegmenter::labelTile(const cv::Rect& tile,
+                               const uint32_t* binMapping) {
+  loadTile(tile);
+  encodeTile(tile);
+  int w = tile.width, h = tile.height;
+  #pragma omp parallel for
+  for(int y = 0; y < h; y++) {
+    uint32_t* row = (uint32_t*)tileCodes.ptr(y);
+    for(int x = 0; x < w; x++) row[x] = binMapping[row[x]];
+  }
+
+  // Labeling replaces the codes, so keep those along the edges.
+  vector<uint32_t> firstCol(h), lastCol(h);
+  vector<uint32_t> firstRow((uint32_t*)tileCodes.ptr(0),
+                            (uint32_t*)tileCodes.ptr(0) + w);
+  vector<uint32_t> lastRow((uint32_t*)tileCodes.ptr(h - 1),
+                           (uint32_t*)tileCodes.ptr(h - 1) + w);
+  for(int y = 0; y < h; y++) {
+    const uint32_t* row = (const uint32_t*)tileCodes.ptr(y);
+    firstCol[y] = row[0];
+    lastCol[y] = row[w - 1];
+  }
+
+  // Tile labels start from 2; move them past the labels already
+  // given in this row of tiles.
+  uint32_t count = findComponents(tileCodes) - 2;
+  uint32_t first = parent.size();
+  parent.resize(first + count);
+  for(uint32_t i = first; i < parent.size(); i++) parent[i] = i;
+  lastTileComponents += count;
+
+  #pragma omp parallel for
+  for(int y = 0; y < h; y++) {
+    uint32_t* row = (uint32_t*)tileCodes.ptr(y);
+    uint32_t* out = labels + (size_t)(tile.y + y)*width + tile.x;
+    for(int x = 0; x < w; x++) out[x] = row[x] = row[x] - 2 + first;
+  }
+
+  if(tile.x > 0) {
+    for(int y = 0; y < h; y++)
+      if(leftCodes[y] == firstCol[y])
+        join(leftLabels[y], ((uint32_t*)tileCodes.ptr(y))[0]);
+  }
+  if(tile.y > 0) {
+    const uint32_t* row = (const uint32_t*)tileCodes.ptr(0);
+    for(int x = 0; x < w; x++)
+      if(aboveCodes[tile.x + x] == firstRow[x])
+        join(aboveLabels[tile.x + x], row[x]);
+  }
+
+  for(int y = 0; y < h; y++) {
+    leftCodes[y] = lastCol[y];
+    leftLabels[y] = ((uint32_t*)tileCodes.ptr(y))[w - 1];
+  }
+  const uint32_t* row = (const uint32_t*)tileCodes.ptr(h - 1);
+  for(int x = 0; x < w; x++) {
+    aboveCodes[tile.x + x] = lastRow[x];
+    aboveLabels[tile.x + x] = row[x];
+  }
+}
+
+// Settle the labels of the row of tiles covering image rows [y0, y1),
+// which [parent] joins to each other and to the regions left open by
+// the rows of tiles above (labels 0 up to the size of the last entry
+// of [openFates]). Regions that do not reach the row's lower edge can
+// grow no further, and are given their final numbers, in the order in
+// which they first appeared; those that do stay open, and are
+// renumbered as the first labels of the next row of tiles. Labels
+// written in this row are rewritten to the final number or to the
+// open region (marked with OPEN_REGION), and the fates of the open
+// regions of the row above are recorded in its entry of [openFates].
+void TiledSegmenter::finishRow(int y0, int y1) {
+  uint32_t numLabels = parent.size();
+  // Parents never exceed their children, so a single ascending pass
+  // points every label at its root.
+  for(uint32_t i = 0; i < numLabels; i++) parent[i] = parent[parent[i]];
+
+  // Mark the roots still open along the lower edge.
+  vector<uint32_t>& fate = rowFates;
+  fate.assign(numLabels, 0);
+  if(y1 < height)
+    for(int x = 0; x < width; x++) fate[parent[aboveLabels[x]]] = 1;
+
+  uint32_t numOpen = 0;
+  for(uint32_t i = 0; i < numLabels; i++) {
+    if(parent[i] != i) fate[i] = fate[parent[i]];
+    else if(fate[i]) fate[i] = OPEN_REGION | numOpen++;
+    else fate[i] = numRegions++;
+  }
+
+  if(!openFates.empty()) {
+    vector<uint32_t>& above = openFates.back();
+    copy(fate.begin(), fate.begin() + above.size(), above.begin());
+  }
+  openFates.push_back(vector<uint32_t>(numOpen));
+
+  #pragma omp parallel for
+  for(int y = y0; y < y1; y++) {
+    uint32_t* row = labels + (size_t)y*width;
+    for(int x = 0; x < width; x++) row[x] = fate[row[x]];
+  }
+  releaseRows(y0, y1);
+
+  // Only the open regions are carried into the next row of tiles.
+  for(int x = 0; x < width; x++)
+    aboveLabels[x] = fate[aboveLabels[x]] & ~OPEN_REGION;
+  parent.resize(numOpen);
+  for(uint32_t i = 0; i < numOpen; i++) parent[i] = i;
+}
+
+// Replace the open regions written in each row of tiles with their
+// final numbers, working up from the bottom, where every region has
+// been closed.
+void TiledSegmenter::resolveOpenRegions() {
+  int rows = openFates.size();
+  for(int r = rows - 2; r >= 0; r--) {
+    vector<uint32_t>& fates = openFates[r];
+    if(fates.empty()) continue;
+    const vector<uint32_t>& below = openFates[r + 1];
+    for(size_t i = 0; i < fates.size(); i++)
+      if(fates[i] & OPEN_REGION) fates[i] = below[fates[i] & ~OPEN_REGION];
+
+    int y0 = r*tileSize, y1 = min(height, y0 + tileSize);
+    #pragma omp parallel for
+    for(int y = y0; y < y1; y++) {
+      uint32_t* row = labels + (size_t)y*width;
+      for(int x = 0; x < width; x++)
+        if(row[x] & OPEN_REGION) row[x] = fates[row[x] & ~OPEN_REGION];
+    }
+    releaseRows(y0, y1);
+  }
+}
+
+int TiledSegmenter::segmentMapped() {
+  int numChannels = convert ? 0 : 3;
+  if(convert) {
+    // Learn the converted channel count from a single pixel.
+    loadTile(cv::Rect(0, 0, 1, 1));
+    numChannels = tileColor.channels();
+  }
+  int numPlanes = planes.size() / numChannels;
+  if(numPlanes > ctx.maxDensePlanes) return 0;
+  ctx.reserve(1, 1, numPlanes);
+
+  // The retries follow hammingHash's, replacing planes from ctx.rng in
+  // the same order.
+  vector<uint32_t> hMaxima;
+  int retryCount = 0;
+  while(retryCount < maxRetries) {
+    retryCount++;
+    hMaxima.clear();
+    histogramPass(numPlanes);
+    hammingMaxima(ctx.bins, ctx.activeBins, numPlanes, hammingK,
+                  ctx.neighborhood, hMaxima);
+    if(hMaxima.empty()) {
+      planes = makeRandomPlanes(numPlanes, numChannels, ctx.rng);
+      continue;
+    }
+
+    bool hasBadPlane = false;
+    vector<float> power = discriminativePower(numPlanes, hMaxima);
+    for(int i = 0; i < numPlanes; i++) {
+      if(power[i] < 0.0001) {
+        hasBadPlane = true;
+        vector<float> plane = makeRandomPlanes(1, numChannels, ctx.rng);
+        copy(plane.begin(), plane.end(), &planes[i*numChannels]);
+      }
+    }
+    if(hasBadPlane && retryCount < maxRetries) continue;
+
+    vector<float> correlations = planeCorrelation(numPlanes, hMaxima);
+    for(int i = 0; i < numPlanes; i++) {
+      if(correlations[i] > 0.9f) {
+        hasBadPlane = true;
+        vector<float> plane = makeRandomPlanes(1, numChannels, ctx.rng);
+        copy(plane.begin(), plane.end(), &planes[i*numChannels]);
+      }
+    }
+    if(hasBadPlane && retryCount < maxRetries) continue;
+    break;
+  }
+  lastAttempts = retryCount;
+  lastMaxima = hMaxima.size();
+  if(hMaxima.empty()) return 0;
+  mapToMaxima(ctx.bins, ctx.activeBins, hMaxima, ctx.binColors,
+              ctx.binMapping, ctx.neighborhood, ctx.search);
+
+  // Label tile by tile. ctx.layout still holds the planes and midpoints
+  // the maxima were found with, whatever the retries replaced since.
+  parent.clear();
+  openFates.clear();
+  numRegions = 0;
+  leftCodes.resize(tileSize);
+  leftLabels.resize(tileSize);
+  aboveCodes.resize(width);
+  aboveLabels.resize(width);
+  int tiles = numTiles();
+  for(int i = 0; i < tiles; i++) {
+    cv::Rect tile = tileAt(i);
+    labelTile(tile, ctx.binMapping);
+    if(tile.x + tile.width == width) finishRow(tile.y, tile.y + tile.height);
+  }
+  resolveOpenRegions();
+  lastRegions = numRegions;
+  return lastRegions;
+}